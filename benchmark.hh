@@ -0,0 +1,339 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.hh
+//
+// Repeatable timing for the solvers in maxcalorie.hh.
+//
+// run_benchmark times one case: a few untimed warm-up calls, then repeated
+// timed calls until either the repeat count or the time budget runs out,
+// summarized by the minimum, median, mean and 99th percentile. Results are
+// written as CSV or JSON, and a CSV from an earlier commit can be read back
+// and compared case by case to flag regressions. pin_to_cpu keeps the
+// timing thread on one core, so the samples are not spread over cores with
+// different caches and clocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "maxcalorie.hh"
+
+
+// How many times to run a case.
+// At least min_repeats timed runs are made. After that, runs stop at
+// repeats, or as soon as the timed runs add up to max_seconds, whichever
+// comes first, so slow cases (exhaustive search at large n) stay bounded.
+struct BenchmarkOptions
+{
+	unsigned warmup = 2;
+	unsigned repeats = 15;
+	unsigned min_repeats = 3;
+	double max_seconds = 1.0;
+};
+
+// The timing summary of one case, in seconds. value is whatever the case
+// reports about its answer (the total calories, say), so runs can also be
+// checked for agreement.
+struct BenchmarkResult
+{
+	std::string solver;
+	std::string distribution;
+	size_t n = 0;
+	double capacity = 0;
+	unsigned repeats = 0;
+	double min_seconds = 0;
+	double median_seconds = 0;
+	double mean_seconds = 0;
+	double p99_seconds = 0;
+	double value = 0;
+};
+
+// The nearest-rank percentile (0 < fraction <= 1) of sorted samples.
+inline double benchmark_percentile(const std::vector<double>& sorted, double fraction)
+{
+	assert(!sorted.empty());
+	size_t rank = size_t(std::ceil(fraction * sorted.size()));
+	rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+	return sorted[rank - 1];
+}
+
+// Time solve(), which takes no arguments and returns the value to record,
+// according to options.
+template <typename Solve>
+BenchmarkResult run_benchmark
+(
+	const std::string& solver,
+	const std::string& distribution,
+	size_t n,
+	double capacity,
+	Solve&& solve,
+	const BenchmarkOptions& options = BenchmarkOptions()
+)
+{
+	BenchmarkResult result;
+	result.solver = solver;
+	result.distribution = distribution;
+	result.n = n;
+	result.capacity = capacity;
+
+	for (unsigned k = 0; k < options.warmup; k++)
+	{
+		result.value = solve();
+	}
+
+	std::vector<double> samples;
+	samples.reserve(options.repeats);
+	double total = 0;
+	while (
+		samples.size() < std::max(options.repeats, 1u)
+		&& (samples.size() < options.min_repeats || total < options.max_seconds)
+	)
+	{
+		auto start = std::chrono::steady_clock::now();
+		result.value = solve();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		samples.push_back(elapsed.count());
+		total += elapsed.count();
+	}
+
+	std::sort(samples.begin(), samples.end());
+	result.repeats = samples.size();
+	result.min_seconds = samples.front();
+	result.median_seconds = samples.size() % 2 == 1
+		? samples[samples.size() / 2]
+		: (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+	result.mean_seconds = total / samples.size();
+	result.p99_seconds = benchmark_percentile(samples, 0.99);
+	return result;
+}
+
+// Restrict the calling thread, and the threads it starts from then on, to
+// one CPU. Threads started earlier keep their own CPUs. Returns false where
+// that is not supported or not allowed.
+inline bool pin_to_cpu(unsigned cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+// The CPUs the calling thread may run on, saved before pin_to_cpu so that
+// cases which start their own threads can be given all of them back.
+struct CpuAffinity
+{
+#ifdef __linux__
+	cpu_set_t set;
+#endif
+	bool saved = false;
+};
+
+inline CpuAffinity current_cpu_affinity()
+{
+	CpuAffinity affinity;
+#ifdef __linux__
+	CPU_ZERO(&affinity.set);
+	affinity.saved = sched_getaffinity(0, sizeof(affinity.set), &affinity.set) == 0;
+#endif
+	return affinity;
+}
+
+// Put back a saved affinity on the calling thread. Returns false if there
+// was none to put back.
+inline bool restore_cpu_affinity(const CpuAffinity& affinity)
+{
+#ifdef __linux__
+	return affinity.saved && sched_setaffinity(0, sizeof(affinity.set), &affinity.set) == 0;
+#else
+	(void)affinity;
+	return false;
+#endif
+}
+
+// Synthetic catalogs of n items for the distribution sweeps, the same for
+// the same seed on every run:
+//   uniform: weights 1..100 ounces and calories 1..1000, independent.
+//   correlated: calories = 10 * weight + 0..99, the classic hard case where
+//     every item is nearly as dense as every other.
+//   duplicates: only 8 distinct (weight, calories) pairs.
+// Anything else returns an empty catalog.
+inline FoodCatalog make_benchmark_catalog(const std::string& distribution, size_t n, uint64_t seed = 1)
+{
+	FoodCatalog catalog;
+	std::mt19937_64 random(seed);
+	std::uniform_int_distribution<int> weight(1, 100), calories(1, 1000), noise(0, 99), pair(0, 7);
+	for (size_t i = 0; i < n; i++)
+	{
+		std::string description = distribution + " " + std::to_string(i);
+		if (distribution == "uniform")
+		{
+			catalog.push_back(description, weight(random), calories(random));
+		}
+		else if (distribution == "correlated")
+		{
+			const int w = weight(random);
+			catalog.push_back(description, w, 10 * w + noise(random));
+		}
+		else if (distribution == "duplicates")
+		{
+			const int k = pair(random);
+			catalog.push_back(description, 5 + 7 * k, 40 + 75 * k - 3 * k * k);
+		}
+		else
+		{
+			break;
+		}
+	}
+	return catalog;
+}
+
+// Write results as CSV, one row per case, with a header row.
+inline void write_benchmark_csv(std::ostream& out, const std::vector<BenchmarkResult>& results)
+{
+	out << "solver,distribution,n,capacity,repeats,min_seconds,median_seconds,mean_seconds,p99_seconds,value\n";
+	out << std::setprecision(10);
+	for (const BenchmarkResult& r : results)
+	{
+		out
+			<< r.solver << ',' << r.distribution << ',' << r.n << ',' << r.capacity << ','
+			<< r.repeats << ',' << r.min_seconds << ',' << r.median_seconds << ','
+			<< r.mean_seconds << ',' << r.p99_seconds << ',' << r.value << '\n'
+			;
+	}
+}
+
+// Write results as a JSON object: {"label": ..., "results": [...]}. The
+// label (a commit id, say) is written as given and must not need escaping.
+inline void write_benchmark_json(std::ostream& out, const std::string& label, const std::vector<BenchmarkResult>& results)
+{
+	out << std::setprecision(10);
+	out << "{\n  \"label\": \"" << label << "\",\n  \"results\": [\n";
+	for (size_t k = 0; k < results.size(); k++)
+	{
+		const BenchmarkResult& r = results[k];
+		out
+			<< "    {\"solver\": \"" << r.solver << "\", \"distribution\": \"" << r.distribution << "\""
+			<< ", \"n\": " << r.n << ", \"capacity\": " << r.capacity << ", \"repeats\": " << r.repeats
+			<< ", \"min_seconds\": " << r.min_seconds << ", \"median_seconds\": " << r.median_seconds
+			<< ", \"mean_seconds\": " << r.mean_seconds << ", \"p99_seconds\": " << r.p99_seconds
+			<< ", \"value\": " << r.value << "}" << (k + 1 < results.size() ? "," : "") << "\n"
+			;
+	}
+	out << "  ]\n}\n";
+}
+
+// Read back a file written by write_benchmark_csv. Returns false if the file
+// cannot be opened or a row is malformed.
+inline bool read_benchmark_csv(const std::string& path, std::vector<BenchmarkResult>& results)
+{
+	std::ifstream f(path);
+	if (!f)
+	{
+		return false;
+	}
+
+	results.clear();
+	std::string line;
+	std::getline(f, line);
+	while (std::getline(f, line))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+		std::vector<std::string> fields;
+		std::stringstream ss(line);
+		for (std::string field; std::getline(ss, field, ','); )
+		{
+			fields.push_back(field);
+		}
+		if (fields.size() != 10)
+		{
+			return false;
+		}
+
+		BenchmarkResult r;
+		try
+		{
+			r.solver = fields[0];
+			r.distribution = fields[1];
+			r.n = std::stoul(fields[2]);
+			r.capacity = std::stod(fields[3]);
+			r.repeats = std::stoul(fields[4]);
+			r.min_seconds = std::stod(fields[5]);
+			r.median_seconds = std::stod(fields[6]);
+			r.mean_seconds = std::stod(fields[7]);
+			r.p99_seconds = std::stod(fields[8]);
+			r.value = std::stod(fields[9]);
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+		results.push_back(r);
+	}
+	return true;
+}
+
+// Compare current results with a baseline, matching cases on solver,
+// distribution, n and capacity. Returns one message per case whose median
+// got slower by more than tolerance (0.10 is 10%), or whose value changed.
+inline std::vector<std::string> compare_benchmarks
+(
+	const std::vector<BenchmarkResult>& baseline,
+	const std::vector<BenchmarkResult>& current,
+	double tolerance
+)
+{
+	std::vector<std::string> regressions;
+	for (const BenchmarkResult& now : current)
+	{
+		for (const BenchmarkResult& before : baseline)
+		{
+			if (
+				before.solver != now.solver || before.distribution != now.distribution
+				|| before.n != now.n || before.capacity != now.capacity
+			)
+			{
+				continue;
+			}
+
+			std::ostringstream message;
+			message << now.solver << " " << now.distribution << " n=" << now.n << " capacity=" << now.capacity << ": ";
+			if (now.median_seconds > before.median_seconds * (1 + tolerance))
+			{
+				message << "median " << before.median_seconds << "s -> " << now.median_seconds << "s";
+				regressions.push_back(message.str());
+			}
+			else if (std::abs(now.value - before.value) > 1e-6 * std::max(1.0, std::abs(before.value)))
+			{
+				message << "value " << before.value << " -> " << now.value;
+				regressions.push_back(message.str());
+			}
+			break;
+		}
+	}
+	return regressions;
+}
@@ -0,0 +1,2922 @@
+////////////////////////////////////////////////////////////////////////////////
+// maxcalorie.cc
+//
+// Definitions of the loaders, helpers and solvers declared in maxcalorie.hh,
+// which documents them.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "maxcalorie.hh"
+
+#ifdef MAXCALORIE_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+
+// Set v to count copies of value, reusing its storage. With
+// MAXCALORIE_STATS, any growth of the storage counts as bytes_allocated.
+template <typename Value>
+static void assign_scratch(std::vector<Value>& v, size_t count, const Value& value)
+{
+#ifdef MAXCALORIE_STATS
+	const size_t before = v.capacity();
+#endif
+	v.assign(count, value);
+	MAXCALORIE_STATS_ADD(bytes_allocated, (v.capacity() - before) * sizeof(Value));
+}
+
+// Size v to count elements, reusing its storage; unlike assign_scratch, the
+// elements it already had keep their stale values.
+template <typename Value>
+static void resize_scratch(std::vector<Value>& v, size_t count)
+{
+#ifdef MAXCALORIE_STATS
+	const size_t before = v.capacity();
+#endif
+	v.resize(count);
+	MAXCALORIE_STATS_ADD(bytes_allocated, (v.capacity() - before) * sizeof(Value));
+}
+
+bool parse_food_header(std::string_view header, FoodColumns& columns)
+{
+	columns = FoodColumns();
+	if (!header.empty() && header.back() == '\r')
+	{
+		header.remove_suffix(1);
+	}
+
+	size_t column = 0;
+	for (std::string_view rest = header; ; column++)
+	{
+		const size_t field_end = rest.find('^');
+		std::string_view name = rest.substr(0, field_end);
+		while (!name.empty() && (name.front() == ' ' || name.front() == '\t'))
+		{
+			name.remove_prefix(1);
+		}
+		while (!name.empty() && (name.back() == ' ' || name.back() == '\t'))
+		{
+			name.remove_suffix(1);
+		}
+
+		if (column >= 3)
+		{
+			if (name == "Quantity" && columns.quantity == 0)
+			{
+				columns.quantity = column;
+			}
+			else if (name == "Volume" && columns.volume == 0)
+			{
+				columns.volume = column;
+			}
+			else if (name == "Cost" && columns.cost == 0)
+			{
+				columns.cost = column;
+			}
+			else
+			{
+				std::cout << "Failed to load food database: Unknown or repeated column in header: " << name << std::endl;
+				return false;
+			}
+			columns.field_count = column + 1;
+		}
+
+		if (field_end == std::string_view::npos)
+		{
+			break;
+		}
+		rest.remove_prefix(field_end + 1);
+	}
+
+	return true;
+}
+
+bool is_food_quantity(double value)
+{
+	return value >= 1 && value <= UINT32_MAX && value == std::floor(value);
+}
+
+std::unique_ptr<FoodVector> load_food_database(const std::string& path)
+{
+	MAXCALORIE_STATS_SCOPE(load_nanoseconds);
+	std::unique_ptr<FoodVector> failure(nullptr);
+
+	std::ifstream f(path);
+	if (!f)
+	{
+		std::cout << "Failed to load food database; cannot open file: " << path << std::endl;
+		return failure;
+	}
+
+	std::unique_ptr<FoodVector> result(new FoodVector);
+
+	FoodColumns columns;
+	size_t line_number = 0;
+	for (std::string line; std::getline(f, line); )
+	{
+		line_number++;
+
+		// First line is a header row
+		if ( line_number == 1 )
+		{
+			if (!parse_food_header(line, columns))
+			{
+				return failure;
+			}
+			continue;
+		}
+
+		std::vector<std::string> fields;
+		std::stringstream ss(line);
+
+		for (std::string field; std::getline(ss, field, '^'); )
+		{
+			fields.push_back(field);
+		}
+
+		if (fields.size() != columns.field_count)
+		{
+			std::cout
+				<< "Failed to load food database: Invalid field count at line " << line_number << "; Want " << columns.field_count << " but got " << fields.size() << std::endl
+				<< "Line: " << line << std::endl
+				;
+			return failure;
+		}
+
+		std::string
+			descr_field = fields[0],
+			weight_ounces_field = fields[1],
+			calories_field = fields[2]
+			;
+
+		auto parse_dbl = [](const std::string& field, double& output)
+		{
+			std::stringstream ss(field);
+			ss >> output;
+
+			// Fail unless a number was read and only whitespace follows it.
+			return ss && (ss >> std::ws).eof() && std::isfinite(output);
+		};
+
+		std::string description(descr_field);
+		double weight_ounces, calories, quantity = 1, volume = 0, cost = 0;
+		if (
+			!description.empty()
+			&& parse_dbl(weight_ounces_field, weight_ounces)
+			&& parse_dbl(calories_field, calories)
+			&& weight_ounces > 0
+			&& (columns.quantity == 0 || (parse_dbl(fields[columns.quantity], quantity) && is_food_quantity(quantity)))
+			&& (columns.volume == 0 || (parse_dbl(fields[columns.volume], volume) && volume >= 0))
+			&& (columns.cost == 0 || (parse_dbl(fields[columns.cost], cost) && cost >= 0))
+		)
+		{
+			result->push_back(
+				std::shared_ptr<FoodItem>(
+					new FoodItem(
+						description,
+						weight_ounces,
+						calories,
+						uint32_t(quantity),
+						volume,
+						cost
+					)
+				)
+			);
+		}
+	}
+
+	f.close();
+
+	return result;
+}
+
+bool parse_food_number(std::string_view field, double& output)
+{
+	while (!field.empty() && (field.front() == ' ' || field.front() == '\t'))
+	{
+		field.remove_prefix(1);
+	}
+	while (!field.empty() && (field.back() == ' ' || field.back() == '\t'))
+	{
+		field.remove_suffix(1);
+	}
+
+	const char* end = field.data() + field.size();
+	auto [ptr, error] = std::from_chars(field.data(), end, output);
+	return error == std::errc() && ptr == end && std::isfinite(output);
+}
+
+bool parse_food_lines
+(
+	std::string_view text,
+	size_t first_line_number,
+	FoodCatalog& catalog,
+	const FoodColumns& columns
+)
+{
+	size_t line_number = first_line_number;
+	while (!text.empty())
+	{
+		size_t line_end = text.find('\n');
+		std::string_view line = text.substr(0, line_end);
+		text.remove_prefix(line_end == std::string_view::npos ? text.size() : line_end + 1);
+
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.remove_suffix(1);
+		}
+
+		std::string_view fields[FOOD_MAX_COLUMNS];
+		size_t field_count = 0;
+		for (std::string_view rest = line; ; )
+		{
+			size_t field_end = rest.find('^');
+			if (field_count < FOOD_MAX_COLUMNS)
+			{
+				fields[field_count] = rest.substr(0, field_end);
+			}
+			field_count++;
+
+			if (field_end == std::string_view::npos)
+			{
+				break;
+			}
+			rest.remove_prefix(field_end + 1);
+		}
+
+		if (line.empty() || field_count != columns.field_count)
+		{
+			std::cout
+				<< "Failed to load food database: Invalid field count at line " << line_number << "; Want " << columns.field_count << " but got " << (line.empty() ? 0 : field_count) << std::endl
+				<< "Line: " << line << std::endl
+				;
+			return false;
+		}
+
+		double weight_ounces, calories, quantity = 1, volume = 0, cost = 0;
+		if (
+			!fields[0].empty()
+			&& parse_food_number(fields[1], weight_ounces)
+			&& parse_food_number(fields[2], calories)
+			&& weight_ounces > 0
+			&& (columns.quantity == 0 || (parse_food_number(fields[columns.quantity], quantity) && is_food_quantity(quantity)))
+			&& (columns.volume == 0 || (parse_food_number(fields[columns.volume], volume) && volume >= 0))
+			&& (columns.cost == 0 || (parse_food_number(fields[columns.cost], cost) && cost >= 0))
+		)
+		{
+			catalog.push_back(fields[0], weight_ounces, calories, uint32_t(quantity), volume, cost);
+		}
+
+		line_number++;
+	}
+
+	return true;
+}
+
+std::unique_ptr<FoodCatalog> load_food_catalog(const std::string& path)
+{
+	MAXCALORIE_STATS_SCOPE(load_nanoseconds);
+	std::unique_ptr<FoodCatalog> failure(nullptr);
+
+	std::ifstream f(path, std::ios::binary | std::ios::ate);
+	if (!f)
+	{
+		std::cout << "Failed to load food database; cannot open file: " << path << std::endl;
+		return failure;
+	}
+
+	std::string buffer(size_t(f.tellg()), '\0');
+	f.seekg(0);
+	if (!f.read(&buffer[0], buffer.size()))
+	{
+		std::cout << "Failed to load food database; cannot read file: " << path << std::endl;
+		return failure;
+	}
+	f.close();
+
+	// First line is a header row
+	std::string_view text(buffer);
+	size_t header_end = text.find('\n');
+	FoodColumns columns;
+	if (!parse_food_header(text.substr(0, header_end), columns))
+	{
+		return failure;
+	}
+	text.remove_prefix(header_end == std::string_view::npos ? text.size() : header_end + 1);
+
+	std::unique_ptr<FoodCatalog> result(new FoodCatalog);
+	result->reserve(std::count(text.begin(), text.end(), '\n') + 1, text.size());
+
+	if (!parse_food_lines(text, 2, *result, columns))
+	{
+		return failure;
+	}
+
+	return result;
+}
+
+std::unique_ptr<FoodCatalog> load_food_catalog_parallel(const std::string& path, ThreadPool& pool)
+{
+	MAXCALORIE_STATS_SCOPE(load_nanoseconds);
+	std::unique_ptr<FoodCatalog> failure(nullptr);
+
+	std::ifstream f(path, std::ios::binary | std::ios::ate);
+	if (!f)
+	{
+		std::cout << "Failed to load food database; cannot open file: " << path << std::endl;
+		return failure;
+	}
+
+	std::string buffer(size_t(f.tellg()), '\0');
+	f.seekg(0);
+	if (!f.read(&buffer[0], buffer.size()))
+	{
+		std::cout << "Failed to load food database; cannot read file: " << path << std::endl;
+		return failure;
+	}
+	f.close();
+
+	// First line is a header row
+	std::string_view text(buffer);
+	size_t header_end = text.find('\n');
+	FoodColumns columns;
+	if (!parse_food_header(text.substr(0, header_end), columns))
+	{
+		return failure;
+	}
+	text.remove_prefix(header_end == std::string_view::npos ? text.size() : header_end + 1);
+
+	// Piece t is text[cuts[t], cuts[t + 1]), each cut just after a newline.
+	const unsigned threads = pool.size();
+	std::vector<size_t> cuts(threads + 1, text.size());
+	cuts[0] = 0;
+	for (unsigned t = 1; t < threads; t++)
+	{
+		const size_t newline = text.find('\n', std::max(cuts[t - 1], text.size() / threads * t));
+		cuts[t] = newline == std::string_view::npos ? text.size() : newline + 1;
+	}
+
+	std::vector<size_t> lines(threads, 0);
+	std::vector<FoodCatalog> segments(threads);
+	std::vector<char> parsed(threads, 0);
+	SpinBarrier barrier(threads);
+	pool.run([&](unsigned t)
+	{
+		const std::string_view piece = text.substr(cuts[t], cuts[t + 1] - cuts[t]);
+		lines[t] = std::count(piece.begin(), piece.end(), '\n');
+		barrier.wait();
+
+		size_t first_line = 2;
+		for (unsigned k = 0; k < t; k++)
+		{
+			first_line += lines[k];
+		}
+		segments[t].reserve(lines[t] + 1, piece.size());
+		parsed[t] = parse_food_lines(piece, first_line, segments[t], columns);
+	});
+
+	size_t items = 0, description_bytes = 0;
+	for (unsigned t = 0; t < threads; t++)
+	{
+		if (!parsed[t])
+		{
+			return failure;
+		}
+		items += segments[t].size();
+		description_bytes += cuts[t + 1] - cuts[t];
+	}
+
+	std::unique_ptr<FoodCatalog> result(new FoodCatalog);
+	result->reserve(items, description_bytes);
+	for (FoodCatalog& segment : segments)
+	{
+		result->append(segment);
+		segment = FoodCatalog();
+	}
+	return result;
+}
+
+uint64_t food_snapshot_quantity_bytes(uint64_t n)
+{
+	return (n * sizeof(uint32_t) + 7) / 8 * 8;
+}
+
+bool save_food_snapshot
+(
+	const FoodCatalog& catalog,
+	const std::string& path,
+	uint64_t source_bytes
+)
+{
+	std::ofstream f(path, std::ios::binary | std::ios::trunc);
+	if (!f)
+	{
+		std::cout << "Failed to save food snapshot; cannot open file: " << path << std::endl;
+		return false;
+	}
+
+	FoodSnapshotHeader header;
+	std::copy(FOOD_SNAPSHOT_MAGIC, FOOD_SNAPSHOT_MAGIC + 8, header.magic);
+	header.version = FOOD_SNAPSHOT_VERSION;
+	header.byte_order = FOOD_SNAPSHOT_BYTE_ORDER;
+	header.item_count = catalog.size();
+	header.pool_bytes = catalog._description_pool.size();
+	header.source_bytes = source_bytes;
+	header.content_hash = catalog._content_hash;
+
+	std::vector<uint64_t> offsets(catalog._description_offsets.begin(), catalog._description_offsets.end());
+
+	f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	f.write(reinterpret_cast<const char*>(catalog._weights.data()), catalog.size() * sizeof(double));
+	f.write(reinterpret_cast<const char*>(catalog._calories.data()), catalog.size() * sizeof(double));
+	f.write(reinterpret_cast<const char*>(catalog._quantities.data()), catalog.size() * sizeof(uint32_t));
+	f.write("\0\0\0\0", food_snapshot_quantity_bytes(catalog.size()) - catalog.size() * sizeof(uint32_t));
+	f.write(reinterpret_cast<const char*>(catalog._volumes.data()), catalog.size() * sizeof(double));
+	f.write(reinterpret_cast<const char*>(catalog._costs.data()), catalog.size() * sizeof(double));
+	f.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	f.write(catalog._description_pool.data(), catalog._description_pool.size());
+	f.close();
+
+	if (!f)
+	{
+		std::cout << "Failed to save food snapshot; cannot write file: " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+std::unique_ptr<FoodCatalog> load_food_snapshot
+(
+	const std::string& path,
+	uint64_t source_bytes
+)
+{
+	MAXCALORIE_STATS_SCOPE(load_nanoseconds);
+	std::unique_ptr<FoodCatalog> failure(nullptr);
+
+	std::ifstream f(path, std::ios::binary | std::ios::ate);
+	if (!f)
+	{
+		return failure;
+	}
+	const uint64_t file_bytes = uint64_t(f.tellg());
+	f.seekg(0);
+
+	FoodSnapshotHeader header;
+	if (
+		file_bytes < sizeof(header)
+		|| !f.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| !std::equal(FOOD_SNAPSHOT_MAGIC, FOOD_SNAPSHOT_MAGIC + 8, header.magic)
+		|| header.version != FOOD_SNAPSHOT_VERSION
+		|| header.byte_order != FOOD_SNAPSHOT_BYTE_ORDER
+		|| (source_bytes != 0 && header.source_bytes != source_bytes)
+	)
+	{
+		return failure;
+	}
+
+	const uint64_t n = header.item_count;
+	if (
+		n > file_bytes / (5 * sizeof(double))
+		|| file_bytes != sizeof(header) + n * 4 * sizeof(double) + food_snapshot_quantity_bytes(n) + (n + 1) * sizeof(uint64_t) + header.pool_bytes
+	)
+	{
+		std::cout << "Failed to load food snapshot; truncated file: " << path << std::endl;
+		return failure;
+	}
+
+	std::unique_ptr<FoodCatalog> result(new FoodCatalog);
+	std::vector<uint64_t> offsets(n + 1);
+	result->_weights.resize(n);
+	result->_calories.resize(n);
+	result->_quantities.resize(n);
+	result->_volumes.resize(n);
+	result->_costs.resize(n);
+	result->_description_pool.resize(header.pool_bytes);
+
+	char padding[8];
+	f.read(reinterpret_cast<char*>(result->_weights.data()), n * sizeof(double));
+	f.read(reinterpret_cast<char*>(result->_calories.data()), n * sizeof(double));
+	f.read(reinterpret_cast<char*>(result->_quantities.data()), n * sizeof(uint32_t));
+	f.read(padding, food_snapshot_quantity_bytes(n) - n * sizeof(uint32_t));
+	f.read(reinterpret_cast<char*>(result->_volumes.data()), n * sizeof(double));
+	f.read(reinterpret_cast<char*>(result->_costs.data()), n * sizeof(double));
+	f.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	f.read(&result->_description_pool[0], header.pool_bytes);
+	// Ascending offsets from 0 to pool_bytes keep every description in the pool.
+	if (!f || offsets.front() != 0 || offsets.back() != header.pool_bytes || !std::is_sorted(offsets.begin(), offsets.end()))
+	{
+		std::cout << "Failed to load food snapshot; corrupt file: " << path << std::endl;
+		return failure;
+	}
+
+	result->_description_offsets.assign(offsets.begin(), offsets.end());
+	result->_content_hash = header.content_hash;
+	return result;
+}
+
+std::unique_ptr<FoodCatalog> load_food_catalog
+(
+	const std::string& csv_path,
+	const std::string& snapshot_path
+)
+{
+	std::error_code error;
+	const auto csv_time = std::filesystem::last_write_time(csv_path, error);
+	const uint64_t csv_bytes = error ? 0 : std::filesystem::file_size(csv_path, error);
+	if (error)
+	{
+		return load_food_catalog(csv_path);
+	}
+
+	const auto snapshot_time = std::filesystem::last_write_time(snapshot_path, error);
+	if (!error && snapshot_time > csv_time)
+	{
+		std::unique_ptr<FoodCatalog> snapshot = load_food_snapshot(snapshot_path, csv_bytes);
+		if (snapshot)
+		{
+			return snapshot;
+		}
+	}
+
+	std::unique_ptr<FoodCatalog> result = load_food_catalog(csv_path);
+	if (result)
+	{
+		save_food_snapshot(*result, snapshot_path, csv_bytes);
+	}
+	return result;
+}
+
+void sum_food_vector
+(
+	const FoodVector& foods,
+	double& total_weight,
+	double& total_calories
+)
+{
+	total_weight = total_calories = 0;
+	for (auto& food : foods)
+	{
+		total_weight += food->weight();
+		total_calories += food->foodCalories();
+	}
+}
+
+void print_food_vector(const FoodVector& foods)
+{
+	std::cout << "*** food Vector ***" << std::endl;
+
+	if ( foods.size() == 0 )
+	{
+		std::cout << "[empty food list]" << std::endl;
+	}
+	else
+	{
+		for (auto& food : foods)
+		{
+			std::cout
+				<< "Ye olde " << food->description()
+				<< " ==> "
+				<< "Weight of " << food->weight() << " ounces"
+				<< "; calories = " << food->foodCalories()
+				<< std::endl
+				;
+		}
+
+		double total_weight, total_calories;
+		sum_food_vector(foods, total_weight, total_calories);
+		std::cout
+			<< "> Grand total weight: " << total_weight << " ounces" << std::endl
+			<< "> Grand total calories: " << total_calories
+			<< std::endl
+			;
+	}
+}
+
+std::unique_ptr<FoodVector> filter_food_vector
+(
+	const FoodVector& source,
+	double min_calories,
+	double max_calories,
+	int total_size
+)
+{
+	if(total_size <= 0)
+	{
+		std::cout << "invalid total size\n";
+		return nullptr;
+	}
+
+	// Initialize the vector that will hold the filtered items.
+	std::unique_ptr<FoodVector> FilteredFoodVector(new FoodVector);
+
+	// Loop to go through all the items in the food vector.
+	for(auto& food: source)
+	{
+		// If the item satisfies the requirements of the minimum calories, maximum
+		// calories and within the size constraints, it will be added to our filtered
+		// vector.
+		if (food->foodCalories() >= min_calories && food->foodCalories() <= max_calories)
+		{
+			if (int(FilteredFoodVector->size()) < total_size)
+			{
+				FilteredFoodVector->push_back(food);
+			}
+
+			// If we have filled up our vector, we will just break out the loop.
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	// Return the vector with the filtered items
+	return FilteredFoodVector;
+}
+
+std::unique_ptr<FoodVector> select_food_vector
+(
+	const FoodVector& foods,
+	const FoodIndexVector& indices
+)
+{
+	std::unique_ptr<FoodVector> result(new FoodVector);
+	result->reserve(indices.size());
+	for (size_t i : indices)
+	{
+		result->push_back(foods[i]);
+	}
+	return result;
+}
+
+void remap_food_indices
+(
+	const FoodIndexVector& parent_indices,
+	FoodIndexVector& indices
+)
+{
+	for (size_t& i : indices)
+	{
+		i = parent_indices[i];
+	}
+}
+
+void sum_food_catalog
+(
+	const FoodCatalog& catalog,
+	const FoodIndexVector& indices,
+	double& total_weight,
+	double& total_calories
+)
+{
+	total_weight = total_calories = 0;
+	for (size_t i : indices)
+	{
+		total_weight += catalog.weight(i);
+		total_calories += catalog.foodCalories(i);
+	}
+}
+
+bool filter_food_catalog
+(
+	const FoodCatalog& catalog,
+	double min_calories,
+	double max_calories,
+	int total_size,
+	FoodIndexVector& filtered
+)
+{
+	filtered.clear();
+	if(total_size <= 0)
+	{
+		std::cout << "invalid total size\n";
+		return false;
+	}
+
+	const double* calories = catalog.calories();
+	for (size_t i = 0; i < catalog.size() && int(filtered.size()) < total_size; i++)
+	{
+		if (calories[i] >= min_calories && calories[i] <= max_calories)
+		{
+			filtered.push_back(i);
+		}
+	}
+
+	return true;
+}
+
+bool filter_food_catalog_parallel
+(
+	const FoodCatalog& catalog,
+	double min_calories,
+	double max_calories,
+	int total_size,
+	ThreadPool& pool,
+	FoodIndexVector& filtered
+)
+{
+	filtered.clear();
+	if(total_size <= 0)
+	{
+		std::cout << "invalid total size\n";
+		return false;
+	}
+
+	const unsigned threads = pool.size();
+	const size_t n = catalog.size();
+	std::vector<FoodIndexVector> matches(threads);
+	const double* calories = catalog.calories();
+	pool.run([&](unsigned t)
+	{
+		FoodIndexVector& found = matches[t];
+		for (size_t i = n * t / threads; i < n * (t + 1) / threads && int(found.size()) < total_size; i++)
+		{
+			if (calories[i] >= min_calories && calories[i] <= max_calories)
+			{
+				found.push_back(i);
+			}
+		}
+	});
+
+	for (const FoodIndexVector& found : matches)
+	{
+		const size_t take = std::min(found.size(), size_t(total_size) - filtered.size());
+		filtered.insert(filtered.end(), found.begin(), found.begin() + take);
+	}
+	return true;
+}
+
+std::unique_ptr<FoodIndexVector> filter_food_catalog
+(
+	const FoodCatalog& catalog,
+	double min_calories,
+	double max_calories,
+	int total_size
+)
+{
+	std::unique_ptr<FoodIndexVector> filtered(new FoodIndexVector);
+	if (!filter_food_catalog(catalog, min_calories, max_calories, total_size, *filtered))
+	{
+		return nullptr;
+	}
+	return filtered;
+}
+
+SolverWorkspace& thread_solver_workspace()
+{
+	static thread_local SolverWorkspace workspace;
+	return workspace;
+}
+
+std::unique_ptr<FoodIndexVector> prune_dominated_items
+(
+	const FoodCatalog& catalog,
+	double total_weight,
+	PruneStats* stats
+)
+{
+	PruneStats counts;
+	counts.input_items = catalog.size();
+
+	const double* weights = catalog.weights();
+	const double* calories = catalog.calories();
+	FoodIndexVector candidates;
+	candidates.reserve(catalog.size());
+	for (size_t i = 0; i < catalog.size(); i++)
+	{
+		if (weights[i] > total_weight)
+		{
+			counts.over_capacity++;
+		}
+		else if (!(calories[i] > 0))
+		{
+			counts.no_calories++;
+		}
+		else
+		{
+			candidates.push_back(i);
+		}
+	}
+
+	// Group by weight, best calories first within a group.
+	std::sort(candidates.begin(), candidates.end(),
+		[weights, calories](size_t a, size_t b)
+		{
+			if (weights[a] != weights[b])
+			{
+				return weights[a] < weights[b];
+			}
+			if (calories[a] != calories[b])
+			{
+				return calories[a] > calories[b];
+			}
+			return a < b;
+		});
+
+	std::unique_ptr<FoodIndexVector> kept(new FoodIndexVector);
+	for (size_t group = 0; group < candidates.size(); )
+	{
+		const double w = weights[candidates[group]];
+		size_t end = group;
+		while (end < candidates.size() && weights[candidates[end]] == w)
+		{
+			end++;
+		}
+		// Round k up on a near-integer quotient; keeping an extra item is safe.
+		const size_t k = size_t(std::floor(total_weight / w * (1 + 1e-12)));
+		const size_t keep = std::min(k, end - group);
+		kept->insert(kept->end(), candidates.begin() + group, candidates.begin() + group + keep);
+		counts.dominated += (end - group) - keep;
+		group = end;
+	}
+	std::sort(kept->begin(), kept->end());
+
+	counts.kept_items = kept->size();
+	if (stats)
+	{
+		*stats = counts;
+	}
+	return kept;
+}
+
+std::unique_ptr<FoodVector> prune_dominated_items
+(
+	const FoodVector& foods,
+	double total_weight,
+	PruneStats* stats
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *prune_dominated_items(catalog, total_weight, stats));
+}
+
+void exhaustive_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& BestFoodVector
+)
+{
+	const int n = foods.size();
+	assert(n < 64);
+	const double* weights = foods.weights();
+	const double* calories = foods.calories();
+	BestFoodVector.clear();
+	FoodIndexVector& CandidateFoodVector = workspace.candidate;
+	CandidateFoodVector.reserve(n);
+	BestFoodVector.reserve(n);
+
+	// We will Initialize what we need for our loop and the weights and calories.
+	// The subsets are numbered by a 64-bit mask, so any n below 64 works.
+	const uint64_t bitSize = uint64_t(1) << n;
+	double bestTotalCalries = 0;
+	double candTotalWeight = 0;
+	double candTotalCalories = 0;
+
+	for (uint64_t bit = 0; bit < bitSize; bit++)
+	{
+		// We will keep clearing this vector to get ready for the next candidate.
+		// We also set the candidate weight and calorie back to 0.
+		CandidateFoodVector.clear();
+		candTotalWeight = 0;
+		candTotalCalories = 0;
+		for (int j = 0; j < n; j++)
+		{
+			if (((bit >> j) & 1) == 1)
+			{
+				// Adding elements to our candidate vector.
+				CandidateFoodVector.push_back(j);
+				candTotalWeight += weights[j];
+				candTotalCalories += calories[j];
+			}
+		}
+
+		// Only the complete candidate needs checking.
+		if (candTotalWeight <= total_weight && candTotalCalories > bestTotalCalries)
+		{
+			// Copy the candidate into the best vector.
+			bestTotalCalries = candTotalCalories;
+			BestFoodVector = CandidateFoodVector;
+		}
+	}
+	MAXCALORIE_STATS_ADD(subsets, bitSize);
+}
+
+std::unique_ptr<FoodIndexVector> exhaustive_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight
+)
+{
+	SolverWorkspace workspace;
+	std::unique_ptr<FoodIndexVector> BestFoodVector(new FoodIndexVector);
+	exhaustive_max_calories(foods, total_weight, workspace, *BestFoodVector);
+
+	// Return the vector with the items that satisfy the algorithm
+	return BestFoodVector;
+}
+
+std::unique_ptr<FoodVector> exhaustive_max_calories
+(
+	const FoodVector& foods,
+	double total_weight
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *exhaustive_max_calories(catalog, total_weight));
+}
+
+int lowest_set_bit(uint64_t x)
+{
+	assert(x != 0);
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(x);
+#else
+	int bit = 0;
+	while (((x >> bit) & 1) == 0)
+	{
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+void food_indices_from_mask(uint64_t mask, FoodIndexVector& result)
+{
+	result.clear();
+	for (; mask != 0; mask &= mask - 1)
+	{
+		result.push_back(lowest_set_bit(mask));
+	}
+}
+
+std::unique_ptr<FoodIndexVector> food_indices_from_mask(uint64_t mask)
+{
+	std::unique_ptr<FoodIndexVector> result(new FoodIndexVector);
+	food_indices_from_mask(mask, *result);
+	return result;
+}
+
+bool exhaustive_max_calories_gray
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	FoodIndexVector& best,
+	SolverDeadline deadline
+)
+{
+	const int n = foods.size();
+	assert(n < 64);
+	const double* weights = foods.weights();
+	const double* calories = foods.calories();
+
+	const uint64_t subsets = uint64_t(1) << n;
+	uint64_t mask = 0, best_mask = 0;
+	double weight = 0, total_calories = 0, best_calories = 0;
+
+	best.clear();
+	if (solver_deadline_passed(deadline))
+	{
+		return false;
+	}
+	for (uint64_t step = 1; step < subsets; step++)
+	{
+		if (step % GRAY_STEPS_PER_DEADLINE_CHECK == 0 && solver_deadline_passed(deadline))
+		{
+			return false;
+		}
+
+		const int bit = lowest_set_bit(step);
+		mask ^= uint64_t(1) << bit;
+		if ((mask >> bit) & 1)
+		{
+			weight += weights[bit];
+			total_calories += calories[bit];
+		}
+		else
+		{
+			weight -= weights[bit];
+			total_calories -= calories[bit];
+		}
+
+		if (weight <= total_weight && total_calories > best_calories)
+		{
+			best_calories = total_calories;
+			best_mask = mask;
+		}
+	}
+	MAXCALORIE_STATS_ADD(subsets, uint64_t(1) << n);
+
+	food_indices_from_mask(best_mask, best);
+	return true;
+}
+
+std::unique_ptr<FoodIndexVector> exhaustive_max_calories_gray
+(
+	const FoodCatalog& foods,
+	double total_weight
+)
+{
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+	exhaustive_max_calories_gray(foods, total_weight, *best);
+	return best;
+}
+
+std::unique_ptr<FoodVector> exhaustive_max_calories_gray
+(
+	const FoodVector& foods,
+	double total_weight
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *exhaustive_max_calories_gray(catalog, total_weight));
+}
+
+std::unique_ptr<FoodIndexVector> exhaustive_max_calories_parallel
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	ThreadPool& pool
+)
+{
+	const int n = foods.size();
+	assert(n < 64);
+	const double* weights = foods.weights();
+	const double* calories = foods.calories();
+
+	// Up to 4096 chunks, so uneven threads even out, without making the
+	// chunks so small that their from-scratch sums add up. The chunks do not
+	// depend on the thread count, so neither does any chunk's rounding.
+	const unsigned threads = pool.size();
+	const int chunk_bits = std::min(std::max(n - 12, 0), GRAY_PARALLEL_MAX_CHUNK_BITS);
+	const uint64_t chunk_size = uint64_t(1) << chunk_bits;
+	const uint64_t chunk_count = uint64_t(1) << (n - chunk_bits);
+
+	// Best subset per thread, and the Gray-code step at which it was reached.
+	struct Best
+	{
+		double calories = 0;
+		uint64_t step = 0;
+		uint64_t mask = 0;
+	};
+	std::vector<Best> bests(threads);
+	std::atomic<uint64_t> next_chunk(0);
+
+	pool.run([&](unsigned t)
+	{
+		Best& best = bests[t];
+		for (uint64_t chunk; (chunk = next_chunk.fetch_add(1)) < chunk_count; )
+		{
+			const uint64_t first = chunk * chunk_size, last = first + chunk_size;
+
+			uint64_t mask = first ^ (first >> 1);
+			double weight = 0, total_calories = 0;
+			for (uint64_t rest = mask; rest != 0; rest &= rest - 1)
+			{
+				const int bit = lowest_set_bit(rest);
+				weight += weights[bit];
+				total_calories += calories[bit];
+			}
+
+			for (uint64_t step = first; ; )
+			{
+				if (
+					weight <= total_weight
+					&& (total_calories > best.calories || (total_calories == best.calories && step < best.step))
+				)
+				{
+					best.calories = total_calories;
+					best.step = step;
+					best.mask = mask;
+				}
+
+				if (++step == last)
+				{
+					break;
+				}
+
+				const int bit = lowest_set_bit(step);
+				mask ^= uint64_t(1) << bit;
+				if ((mask >> bit) & 1)
+				{
+					weight += weights[bit];
+					total_calories += calories[bit];
+				}
+				else
+				{
+					weight -= weights[bit];
+					total_calories -= calories[bit];
+				}
+			}
+		}
+	});
+
+	Best best;
+	for (const Best& candidate : bests)
+	{
+		if (
+			candidate.calories > best.calories
+			|| (candidate.calories == best.calories && candidate.step < best.step)
+		)
+		{
+			best = candidate;
+		}
+	}
+	MAXCALORIE_STATS_ADD(subsets, uint64_t(1) << n);
+
+	return food_indices_from_mask(best.mask);
+}
+
+std::unique_ptr<FoodIndexVector> exhaustive_max_calories_parallel
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	unsigned thread_count
+)
+{
+	ThreadPool pool(thread_count);
+	return exhaustive_max_calories_parallel(foods, total_weight, pool);
+}
+
+std::unique_ptr<FoodVector> exhaustive_max_calories_parallel
+(
+	const FoodVector& foods,
+	double total_weight,
+	unsigned thread_count
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *exhaustive_max_calories_parallel(catalog, total_weight, thread_count));
+}
+
+std::unique_ptr<FoodIndexVector> mitm_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverDeadline deadline
+)
+{
+	std::unique_ptr<FoodIndexVector> timed_out(nullptr);
+	const int n = foods.size();
+	assert(n < 64);
+	const double* weights = foods.weights();
+	const double* calories = foods.calories();
+
+	const int low_count = n / 2, high_count = n - low_count;
+	MAXCALORIE_STATS_ADD(subsets, (uint64_t(1) << low_count) + (uint64_t(1) << high_count));
+	const double* high_weights = weights + low_count;
+	const double* high_calories = calories + low_count;
+
+	// One subset of the high half; after the prefix pass, calories and mask
+	// describe the best subset weighing at most weight.
+	struct HalfSubset
+	{
+		double weight;
+		double calories;
+		uint32_t mask;
+	};
+
+	// Sum each high subset from the one without its lowest item.
+	const uint64_t high_subsets = uint64_t(1) << high_count;
+	if (solver_deadline_passed(deadline))
+	{
+		return timed_out;
+	}
+	std::vector<HalfSubset> high(high_subsets);
+	high[0] = HalfSubset{0, 0, 0};
+	for (uint64_t mask = 1; mask < high_subsets; mask++)
+	{
+		if (mask % GRAY_STEPS_PER_DEADLINE_CHECK == 0 && solver_deadline_passed(deadline))
+		{
+			return timed_out;
+		}
+		const int bit = lowest_set_bit(mask);
+		const HalfSubset& rest = high[mask & (mask - 1)];
+		high[mask] = HalfSubset{
+			rest.weight + high_weights[bit],
+			rest.calories + high_calories[bit],
+			uint32_t(mask)
+		};
+	}
+
+	high.erase(
+		std::remove_if(high.begin(), high.end(), [&](const HalfSubset& h) { return h.weight > total_weight; }),
+		high.end()
+	);
+	std::sort(high.begin(), high.end(), [](const HalfSubset& x, const HalfSubset& y) { return x.weight < y.weight; });
+	for (size_t i = 1; i < high.size(); i++)
+	{
+		if (high[i].calories <= high[i - 1].calories)
+		{
+			high[i].calories = high[i - 1].calories;
+			high[i].mask = high[i - 1].mask;
+		}
+	}
+
+	const uint64_t low_subsets = uint64_t(1) << low_count;
+	uint64_t low_mask = 0, best_mask = 0;
+	double low_weight = 0, low_calories = 0, best_calories = 0;
+	if (solver_deadline_passed(deadline))
+	{
+		return timed_out;
+	}
+	for (uint64_t step = 0; step < low_subsets; step++)
+	{
+		if (step % GRAY_STEPS_PER_DEADLINE_CHECK == 0 && step != 0 && solver_deadline_passed(deadline))
+		{
+			return timed_out;
+		}
+		if (step != 0)
+		{
+			const int bit = lowest_set_bit(step);
+			low_mask ^= uint64_t(1) << bit;
+			if ((low_mask >> bit) & 1)
+			{
+				low_weight += weights[bit];
+				low_calories += calories[bit];
+			}
+			else
+			{
+				low_weight -= weights[bit];
+				low_calories -= calories[bit];
+			}
+		}
+
+		if (low_weight > total_weight)
+		{
+			continue;
+		}
+
+		// Last high subset that still fits alongside this low subset.
+		const double remaining = total_weight - low_weight;
+		auto fits = std::upper_bound(
+			high.begin(), high.end(), remaining,
+			[](double w, const HalfSubset& h) { return w < h.weight; }
+		);
+		if (fits == high.begin())
+		{
+			continue;
+		}
+		--fits;
+
+		if (low_calories + fits->calories > best_calories)
+		{
+			best_calories = low_calories + fits->calories;
+			best_mask = low_mask | (uint64_t(fits->mask) << low_count);
+		}
+	}
+
+	return food_indices_from_mask(best_mask);
+}
+
+std::unique_ptr<FoodVector> mitm_max_calories
+(
+	const FoodVector& foods,
+	double total_weight
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *mitm_max_calories(catalog, total_weight));
+}
+
+std::unique_ptr<FoodIndexVector> branch_bound_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	const BranchBoundLimits& limits,
+	BranchBoundStats* stats
+)
+{
+	// Items that cannot fit, or cannot add calories, never help.
+	FoodIndexVector order;
+	for (size_t i = 0; i < foods.size(); i++)
+	{
+		if (foods.weight(i) <= total_weight && foods.foodCalories(i) > 0)
+		{
+			order.push_back(i);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y)
+	{
+		return foods.foodCalories(x) * foods.weight(y) > foods.foodCalories(y) * foods.weight(x);
+	});
+
+	BranchBoundSearch search(foods, order, limits);
+	search.run(total_weight);
+	MAXCALORIE_STATS_ADD(branch_bound_nodes, search.stats().nodes);
+	MAXCALORIE_STATS_ADD(branch_bound_pruned, search.stats().pruned);
+
+	if (stats)
+	{
+		*stats = search.stats();
+	}
+
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector(search.best()));
+	std::sort(best->begin(), best->end());
+	return best;
+}
+
+std::unique_ptr<FoodVector> branch_bound_max_calories
+(
+	const FoodVector& foods,
+	double total_weight,
+	const BranchBoundLimits& limits,
+	BranchBoundStats* stats
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *branch_bound_max_calories(catalog, total_weight, limits, stats));
+}
+
+void greedy_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& best_indices,
+	double* upper_bound
+)
+{
+	FoodIndexVector* best = &best_indices;
+	best->clear();
+	if (upper_bound)
+	{
+		*upper_bound = 0;
+	}
+	if (total_weight < 0)
+	{
+		return;
+	}
+
+	// Items that cannot fit, or cannot add calories, never help.
+	FoodIndexVector& order = workspace.order;
+	order.clear();
+	double all_weight = 0, all_calories = 0;
+	for (size_t i = 0; i < foods.size(); i++)
+	{
+		if (foods.weight(i) <= total_weight && foods.foodCalories(i) > 0)
+		{
+			order.push_back(i);
+			all_weight += foods.weight(i);
+			all_calories += foods.foodCalories(i);
+		}
+	}
+
+	// Everything fits: that is the optimum, with no sorting at all.
+	if (order.empty() || all_weight <= total_weight)
+	{
+		*best = order;
+		if (upper_bound)
+		{
+			*upper_bound = all_calories;
+		}
+		return;
+	}
+
+	auto denser = [&](size_t x, size_t y)
+	{
+		return foods.foodCalories(x) * foods.weight(y) > foods.foodCalories(y) * foods.weight(x);
+	};
+
+	// Sort the densest block of order, and then the densest block of what is
+	// left, and so on, until the taken prefix runs into the critical item.
+	// The rounded sum all_weight can exceed total_weight while every item
+	// still fits one at a time; then there is no critical item, and
+	// critical ends at order.size() with everything taken.
+	double capacity = total_weight, calories = 0;
+	size_t critical = 0, sorted = 0, block = 64;
+	for (bool found = false; !found && critical < order.size(); block *= 2)
+	{
+		const size_t end = std::min(order.size(), sorted + block);
+		std::partial_sort(order.begin() + sorted, order.begin() + end, order.end(), denser);
+		for (sorted = end; critical < sorted; critical++)
+		{
+			const size_t i = order[critical];
+			if (foods.weight(i) > capacity)
+			{
+				found = true;
+				break;
+			}
+			best->push_back(i);
+			capacity -= foods.weight(i);
+			calories += foods.foodCalories(i);
+		}
+	}
+
+	if (upper_bound)
+	{
+		*upper_bound = calories;
+		if (critical < order.size())
+		{
+			const size_t i = order[critical];
+			*upper_bound += capacity * foods.foodCalories(i) / foods.weight(i);
+		}
+	}
+
+	// Fill what is left. Past the sorted block this is in catalog order rather
+	// than by density, which only matters for the last few ounces.
+	for (size_t k = critical + 1; k < order.size(); k++)
+	{
+		const size_t i = order[k];
+		if (foods.weight(i) <= capacity)
+		{
+			best->push_back(i);
+			capacity -= foods.weight(i);
+			calories += foods.foodCalories(i);
+		}
+	}
+
+	size_t richest = order[0];
+	for (size_t i : order)
+	{
+		if (foods.foodCalories(i) > foods.foodCalories(richest))
+		{
+			richest = i;
+		}
+	}
+	if (foods.foodCalories(richest) > calories)
+	{
+		best->assign(1, richest);
+	}
+
+	std::sort(best->begin(), best->end());
+}
+
+std::unique_ptr<FoodIndexVector> greedy_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double* upper_bound
+)
+{
+	SolverWorkspace workspace;
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+	greedy_max_calories(foods, total_weight, workspace, *best, upper_bound);
+	return best;
+}
+
+std::unique_ptr<FoodVector> greedy_max_calories
+(
+	const FoodVector& foods,
+	double total_weight,
+	double* upper_bound
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *greedy_max_calories(catalog, total_weight, upper_bound));
+}
+
+void dp_set_take_bits(uint64_t* take, size_t first, uint64_t bits, unsigned count)
+{
+	const size_t word = first / 64, offset = first % 64;
+	take[word] |= bits << offset;
+	if (offset + count > 64 && (bits >> (64 - offset)) != 0)
+	{
+		take[word + 1] |= bits >> (64 - offset);
+	}
+}
+
+#ifdef MAXCALORIE_AVX2_KERNELS
+
+__attribute__((target("avx2")))
+void dp_row_update_avx2
+(
+	const double* prev,
+	double* cur,
+	size_t lo,
+	size_t hi,
+	size_t w,
+	double c,
+	uint64_t* take
+)
+{
+	const size_t start = std::min(hi, std::max(lo, w));
+	const __m256d calories = _mm256_set1_pd(c);
+
+	size_t j = hi;
+	for (; j >= start + 4; )
+	{
+		j -= 4;
+		const __m256d old = _mm256_loadu_pd(prev + j);
+		const __m256d candidate = _mm256_add_pd(_mm256_loadu_pd(prev + j - w), calories);
+		const __m256d better = _mm256_cmp_pd(candidate, old, _CMP_GT_OQ);
+		_mm256_storeu_pd(cur + j, _mm256_blendv_pd(old, candidate, better));
+
+		const unsigned bits = _mm256_movemask_pd(better);
+		if (take && bits)
+		{
+			dp_set_take_bits(take, j, bits, 4);
+		}
+	}
+
+	dp_row_update_scalar(prev, cur, lo, j, w, c, take);
+}
+
+__attribute__((target("avx2")))
+void dp_row_update_avx2
+(
+	const uint32_t* prev,
+	uint32_t* cur,
+	size_t lo,
+	size_t hi,
+	size_t w,
+	uint32_t c,
+	uint64_t* take
+)
+{
+	const size_t start = std::min(hi, std::max(lo, w));
+	const __m256i calories = _mm256_set1_epi32(int32_t(c));
+
+	size_t j = hi;
+	for (; j >= start + 8; )
+	{
+		j -= 8;
+		const __m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j));
+		const __m256i candidate = _mm256_add_epi32(
+			_mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j - w)),
+			calories
+		);
+		const __m256i larger = _mm256_max_epu32(old, candidate);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(cur + j), larger);
+
+		// A lane improved exactly when the maximum differs from the old value.
+		const unsigned kept = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(larger, old)));
+		const unsigned bits = ~kept & 0xFF;
+		if (take && bits)
+		{
+			dp_set_take_bits(take, j, bits, 8);
+		}
+	}
+
+	dp_row_update_scalar(prev, cur, lo, j, w, c, take);
+}
+
+__attribute__((target("avx2")))
+void dp_row_update_avx2
+(
+	const uint64_t* prev,
+	uint64_t* cur,
+	size_t lo,
+	size_t hi,
+	size_t w,
+	uint64_t c,
+	uint64_t* take
+)
+{
+	const size_t start = std::min(hi, std::max(lo, w));
+	const __m256i calories = _mm256_set1_epi64x(int64_t(c));
+
+	size_t j = hi;
+	for (; j >= start + 4; )
+	{
+		j -= 4;
+		const __m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j));
+		const __m256i candidate = _mm256_add_epi64(
+			_mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j - w)),
+			calories
+		);
+
+		// AVX2 only compares signed 64-bit lanes, hence values below 2^63.
+		const __m256i better = _mm256_cmpgt_epi64(candidate, old);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(cur + j), _mm256_blendv_epi8(old, candidate, better));
+
+		const unsigned bits = _mm256_movemask_pd(_mm256_castsi256_pd(better));
+		if (take && bits)
+		{
+			dp_set_take_bits(take, j, bits, 4);
+		}
+	}
+
+	dp_row_update_scalar(prev, cur, lo, j, w, c, take);
+}
+
+#endif
+
+bool dp_row_kernel_vectorized()
+{
+#ifdef MAXCALORIE_AVX2_KERNELS
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported;
+#else
+	return false;
+#endif
+}
+
+size_t dp_weight_unit(double weight_ounces, double weight_resolution)
+{
+	assert(weight_resolution > 0);
+	return std::max<size_t>(1, size_t(std::ceil(weight_ounces / weight_resolution - DP_QUANTIZATION_SLACK)));
+}
+
+void dp_weight_units(const FoodCatalog& catalog, double weight_resolution, std::vector<size_t>& units)
+{
+	units.resize(catalog.size());
+	const double* weights = catalog.weights();
+	for (size_t i = 0; i < units.size(); i++)
+	{
+		units[i] = dp_weight_unit(weights[i], weight_resolution);
+	}
+}
+
+std::vector<size_t> dp_weight_units(const FoodCatalog& catalog, double weight_resolution)
+{
+	std::vector<size_t> units;
+	dp_weight_units(catalog, weight_resolution, units);
+	return units;
+}
+
+size_t dp_capacity_units(double total_weight, double weight_resolution)
+{
+	assert(weight_resolution > 0);
+	assert(total_weight >= 0);
+	return size_t(std::floor(total_weight / weight_resolution + DP_QUANTIZATION_SLACK));
+}
+
+DynamicCost estimate_dynamic_cost
+(
+	size_t item_count,
+	double total_weight,
+	double weight_resolution
+)
+{
+	DynamicCost cost;
+	if (total_weight < 0)
+	{
+		return cost;
+	}
+
+	const uint64_t n = item_count;
+	const uint64_t width = dp_capacity_units(total_weight, weight_resolution) + 1;
+	cost.capacity_units = width - 1;
+	cost.cells = n * width;
+	cost.table_bytes = (n + 1) * width * sizeof(double);
+	cost.rolling_bytes = width * sizeof(double) + n * (width / 64 + 1) * sizeof(uint64_t);
+	cost.linear_memory_bytes = 3 * width * sizeof(double) + n * sizeof(size_t);
+	return cost;
+}
+
+// If all the items together fit in capacity, write the ones worth taking
+// (those with positive calories, which are exactly the ones the DP would
+// take) to best, in descending order, and return true.
+static bool dp_take_all
+(
+	const std::vector<size_t>& weights,
+	const double* calories,
+	size_t capacity,
+	FoodIndexVector& best
+)
+{
+	size_t total = 0;
+	for (size_t w : weights)
+	{
+		total += w;
+		if (total > capacity)
+		{
+			return false;
+		}
+	}
+
+	for (size_t i = weights.size(); i > 0; i--)
+	{
+		if (calories[i - 1] > 0)
+		{
+			best.push_back(i - 1);
+		}
+	}
+	return true;
+}
+
+void dp_take_traceback
+(
+	const std::vector<uint64_t>& take,
+	size_t words_per_row,
+	const std::vector<size_t>& weights,
+	size_t capacity,
+	FoodIndexVector& best
+)
+{
+	MAXCALORIE_STATS_SCOPE(traceback_nanoseconds);
+	size_t prefix = 0;
+	for (size_t w : weights)
+	{
+		prefix += w;
+	}
+
+	// Beyond the prefix weight of the first i items their row is flat, so
+	// the traceback may start from the prefix weight instead; dp_fill_take_bitset
+	// leaves those columns' take bits unset.
+	size_t step = capacity;
+	for (size_t i = weights.size(); i > 0; i--)
+	{
+		step = std::min(step, prefix);
+		prefix -= weights[i - 1];
+		const uint64_t* take_row = &take[(i - 1) * words_per_row];
+		if ((take_row[step / 64] >> (step % 64)) & 1)
+		{
+			best.push_back(i - 1);
+			step -= weights[i - 1];
+		}
+	}
+}
+
+void dynamic_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& best_indices,
+	double weight_resolution
+)
+{
+	FoodIndexVector* best = &best_indices;
+	best->clear();
+
+	if (total_weight < 0)
+	{
+		return;
+	}
+
+	const size_t n = foods.size();
+	const size_t width = dp_capacity_units(total_weight, weight_resolution) + 1;
+	std::vector<size_t>& weights = workspace.units;
+	dp_weight_units(foods, weight_resolution, weights);
+	const double* calories = foods.calories();
+
+	if (dp_take_all(weights, calories, width - 1, *best))
+	{
+		return;
+	}
+
+	// The (n+1) x width DP table as one contiguous array; row i holds the best
+	// calories using only the first i items. The first row is all zeros.
+	// Row i only needs the columns up to the prefix weight of its items,
+	// since past that everything fits and the row is flat; limits[i] is one
+	// past its last computed column. The rest of the table is left stale.
+	std::vector<double>& T = workspace.table;
+	resize_scratch(T, (n + 1) * width);
+	std::vector<size_t>& limits = workspace.limits;
+	resize_scratch(limits, n + 1);
+	T[0] = 0;
+	limits[0] = 1;
+
+	// This is the for loop for creating our DP table. Each row is the row
+	// above with item i either taken or not, whichever is better. The row
+	// above is first extended, flat, to the new row's limit.
+	for (size_t i = 0; i < n; i++)
+	{
+		double* above = &T[i * width];
+		limits[i + 1] = std::min(width, limits[i] + weights[i]);
+		std::fill(above + limits[i], above + limits[i + 1], above[limits[i] - 1]);
+		dp_row_update(above, &T[(i + 1) * width], 0, limits[i + 1], weights[i], calories[i]);
+	}
+
+	// The step is going to be the weight and what we will use to tell us how far
+	// to the left we move. The loop will keep going till we reach the wall.
+	MAXCALORIE_STATS_SCOPE(traceback_nanoseconds);
+	size_t step = width - 1;
+	for (size_t i = n; i > 0; i--)
+	{
+		// If the value differs from the one above, the item was taken.
+		step = std::min(step, limits[i] - 1);
+		if (T[i * width + step] != T[(i - 1) * width + step])
+		{
+			best->push_back(i - 1);
+			step -= weights[i - 1];
+		}
+	}
+}
+
+std::unique_ptr<FoodIndexVector> dynamic_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution
+)
+{
+	SolverWorkspace workspace;
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+	dynamic_max_calories(foods, total_weight, workspace, *best, weight_resolution);
+
+	// Return the vector with the items that satisfy the algorithm
+	return best;
+}
+
+std::unique_ptr<FoodVector> dynamic_max_calories
+(
+	const FoodVector& foods,
+	double total_weight,
+	double weight_resolution
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *dynamic_max_calories(catalog, total_weight, weight_resolution));
+}
+
+// dp_fill_take_bitset for any of the row kernels' value types.
+template <typename Value>
+static size_t dp_fill_take_bitset_values
+(
+	const std::vector<size_t>& weights,
+	const Value* calories,
+	size_t capacity,
+	std::vector<uint64_t>& take,
+	std::vector<Value>& row,
+	SolverDeadline deadline = NO_SOLVER_DEADLINE
+)
+{
+	const size_t n = weights.size();
+	const size_t words_per_row = capacity / 64 + 1;
+	assign_scratch(take, n * words_per_row, uint64_t(0));
+	assign_scratch(row, capacity + 1, Value(0));
+
+	// As in dynamic_max_calories, only the columns up to the prefix weight
+	// are computed; past limit the row is flat at row[limit - 1].
+	size_t limit = 1;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (solver_deadline_passed(deadline))
+		{
+			return 0;
+		}
+
+		// The limit grows even for items too heavy to fit, to match the prefix
+		// weights that dp_take_traceback clamps to.
+		const size_t w = weights[i];
+		const size_t next = std::min(capacity + 1, limit + w);
+		std::fill(row.begin() + limit, row.begin() + next, row[limit - 1]);
+		limit = next;
+		if (w > capacity)
+		{
+			continue;
+		}
+
+		// In place: the kernel walks the columns right to left, so row[j - w]
+		// is still the value from the previous item when it is read.
+		dp_row_update(row.data(), row.data(), 0, limit, w, calories[i], &take[i * words_per_row]);
+	}
+	std::fill(row.begin() + limit, row.end(), row[limit - 1]);
+
+	return words_per_row;
+}
+
+size_t dp_fill_take_bitset
+(
+	const std::vector<size_t>& weights,
+	const double* calories,
+	size_t capacity,
+	std::vector<uint64_t>& take,
+	std::vector<double>& row,
+	SolverDeadline deadline
+)
+{
+	return dp_fill_take_bitset_values(weights, calories, capacity, take, row, deadline);
+}
+
+uint64_t dp_fixed_point_calories(const FoodCatalog& catalog, double scale, std::vector<uint64_t>& values)
+{
+	assert(scale > 0);
+	values.resize(catalog.size());
+	uint64_t total = 0;
+	for (size_t i = 0; i < catalog.size(); i++)
+	{
+		const double scaled = std::round(catalog.foodCalories(i) * scale);
+		assert(scaled < 0x1p62);
+		values[i] = scaled > 0 ? uint64_t(scaled) : 0;
+		total += values[i];
+	}
+	return total;
+}
+
+void dynamic_max_calories_fixed
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& best,
+	double weight_resolution,
+	double calorie_scale
+)
+{
+	best.clear();
+
+	if (total_weight < 0)
+	{
+		return;
+	}
+
+	const size_t capacity = dp_capacity_units(total_weight, weight_resolution);
+	dp_weight_units(foods, weight_resolution, workspace.units);
+	std::vector<uint64_t>& values = workspace.calories64;
+	const uint64_t total = dp_fixed_point_calories(foods, calorie_scale, values);
+	assert(total < (uint64_t(1) << 63));
+
+	size_t words_per_row;
+	if (total <= UINT32_MAX)
+	{
+		workspace.calories32.assign(values.begin(), values.end());
+		words_per_row = dp_fill_take_bitset_values(workspace.units, workspace.calories32.data(), capacity, workspace.take, workspace.row32);
+	}
+	else
+	{
+		words_per_row = dp_fill_take_bitset_values(workspace.units, values.data(), capacity, workspace.take, workspace.row64);
+	}
+
+	dp_take_traceback(workspace.take, words_per_row, workspace.units, capacity, best);
+}
+
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_fixed
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution,
+	double calorie_scale
+)
+{
+	SolverWorkspace workspace;
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+	dynamic_max_calories_fixed(foods, total_weight, workspace, *best, weight_resolution, calorie_scale);
+	return best;
+}
+
+bool dynamic_max_calories_rolling
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& best,
+	double weight_resolution,
+	SolverDeadline deadline
+)
+{
+	best.clear();
+
+	if (total_weight < 0)
+	{
+		return true;
+	}
+
+	const size_t capacity = dp_capacity_units(total_weight, weight_resolution);
+	dp_weight_units(foods, weight_resolution, workspace.units);
+
+	if (dp_take_all(workspace.units, foods.calories(), capacity, best))
+	{
+		return true;
+	}
+
+	const size_t words_per_row = dp_fill_take_bitset(workspace.units, foods.calories(), capacity, workspace.take, workspace.row, deadline);
+	if (words_per_row == 0)
+	{
+		return false;
+	}
+
+	dp_take_traceback(workspace.take, words_per_row, workspace.units, capacity, best);
+	return true;
+}
+
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_rolling
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution
+)
+{
+	SolverWorkspace workspace;
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+	dynamic_max_calories_rolling(foods, total_weight, workspace, *best, weight_resolution);
+	return best;
+}
+
+std::unique_ptr<FoodVector> dynamic_max_calories_rolling
+(
+	const FoodVector& foods,
+	double total_weight,
+	double weight_resolution
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *dynamic_max_calories_rolling(catalog, total_weight, weight_resolution));
+}
+
+void dynamic_max_calories_batch
+(
+	const FoodCatalog& foods,
+	const std::vector<double>& capacities,
+	SolverWorkspace& workspace,
+	std::vector<FoodIndexVector>& results,
+	double weight_resolution
+)
+{
+	results.resize(capacities.size());
+	for (FoodIndexVector& result : results)
+	{
+		result.clear();
+	}
+
+	double largest = -1;
+	for (double total_weight : capacities)
+	{
+		largest = std::max(largest, total_weight);
+	}
+
+	if (largest < 0)
+	{
+		return;
+	}
+
+	const std::vector<size_t>& weights = workspace.units;
+	{
+		PROFILE_SCOPE("batch: weight units");
+		dp_weight_units(foods, weight_resolution, workspace.units);
+	}
+
+	size_t words_per_row;
+	{
+		PROFILE_SCOPE("batch: DP fill");
+		words_per_row = dp_fill_take_bitset(
+			weights, foods.calories(), dp_capacity_units(largest, weight_resolution), workspace.take, workspace.row
+		);
+	}
+
+	for (size_t k = 0; k < capacities.size(); k++)
+	{
+		if (capacities[k] >= 0)
+		{
+			PROFILE_SCOPE("batch: traceback");
+			dp_take_traceback(workspace.take, words_per_row, weights, dp_capacity_units(capacities[k], weight_resolution), results[k]);
+		}
+	}
+}
+
+std::vector<std::unique_ptr<FoodIndexVector>> dynamic_max_calories_batch
+(
+	const FoodCatalog& foods,
+	const std::vector<double>& capacities,
+	double weight_resolution
+)
+{
+	SolverWorkspace workspace;
+	std::vector<FoodIndexVector> indices;
+	dynamic_max_calories_batch(foods, capacities, workspace, indices, weight_resolution);
+
+	std::vector<std::unique_ptr<FoodIndexVector>> results;
+	results.reserve(capacities.size());
+	for (FoodIndexVector& result : indices)
+	{
+		results.emplace_back(new FoodIndexVector(std::move(result)));
+	}
+	return results;
+}
+
+std::vector<std::unique_ptr<FoodVector>> dynamic_max_calories_batch
+(
+	const FoodVector& foods,
+	const std::vector<double>& capacities,
+	double weight_resolution
+)
+{
+	FoodCatalog catalog(foods);
+	std::vector<std::unique_ptr<FoodVector>> results;
+	for (auto& indices : dynamic_max_calories_batch(catalog, capacities, weight_resolution))
+	{
+		results.push_back(select_food_vector(foods, *indices));
+	}
+	return results;
+}
+
+// The filtered items of one chunk of a food database, as passed from the
+// parser thread of streaming_max_calories to its DP.
+struct FoodStreamChunk
+{
+	std::vector<double> weights;
+	std::vector<double> calories;
+	std::vector<uint64_t> offsets;
+};
+
+// The parser thread of streaming_max_calories: read the file after its
+// header line in pieces of chunk_bytes, parse each line, and push the items
+// that pass the filter to queue, until the file ends, total_size items have
+// been pushed, or the queue is closed. Returns false, with a message, on a
+// read error or an invalid line.
+static bool stream_food_chunks
+(
+	std::ifstream& f,
+	uint64_t offset,
+	const FoodColumns& columns,
+	double min_calories,
+	double max_calories,
+	size_t total_size,
+	size_t chunk_bytes,
+	BoundedQueue<FoodStreamChunk>& queue
+)
+{
+	std::string buffer;
+	FoodCatalog parsed;
+	FoodStreamChunk chunk;
+	size_t line_number = 2, kept = 0;
+	bool at_end = false;
+	while (!at_end && kept < total_size)
+	{
+		// buffer holds the unfinished last line of the previous piece, which
+		// starts at offset.
+		const size_t carried = buffer.size();
+		buffer.resize(carried + chunk_bytes);
+		f.read(&buffer[carried], chunk_bytes);
+		buffer.resize(carried + f.gcount());
+		if (f.bad())
+		{
+			std::cout << "Failed to load food database; cannot read file" << std::endl;
+			return false;
+		}
+		at_end = f.eof();
+
+		// Each line is parsed with its newline, so an empty line is an error
+		// as in load_food_catalog; the last line of the file may lack one.
+		std::string_view text(buffer);
+		size_t start = 0;
+		while (start < text.size() && kept < total_size)
+		{
+			size_t end = text.find('\n', start);
+			if (end == std::string_view::npos)
+			{
+				if (!at_end)
+				{
+					break;
+				}
+				end = text.size() - 1;
+			}
+
+			parsed.clear();
+			if (!parse_food_lines(text.substr(start, end + 1 - start), line_number, parsed, columns))
+			{
+				return false;
+			}
+			if (!parsed.empty() && parsed.foodCalories(0) >= min_calories && parsed.foodCalories(0) <= max_calories)
+			{
+				chunk.weights.push_back(parsed.weight(0));
+				chunk.calories.push_back(parsed.foodCalories(0));
+				chunk.offsets.push_back(offset + start);
+				kept++;
+			}
+			line_number++;
+			start = end + 1;
+		}
+
+		offset += start;
+		buffer.erase(0, start);
+		if (!chunk.weights.empty())
+		{
+			if (!queue.push(std::move(chunk)))
+			{
+				return true;
+			}
+			chunk = FoodStreamChunk();
+		}
+	}
+	return true;
+}
+
+std::unique_ptr<FoodCatalog> streaming_max_calories
+(
+	const std::string& path,
+	double min_calories,
+	double max_calories,
+	int total_size,
+	double total_weight,
+	double weight_resolution,
+	size_t chunk_bytes
+)
+{
+	assert(chunk_bytes > 0);
+	std::unique_ptr<FoodCatalog> failure(nullptr);
+	if (total_size <= 0)
+	{
+		std::cout << "invalid total size\n";
+		return failure;
+	}
+
+	std::ifstream f(path, std::ios::binary);
+	if (!f)
+	{
+		std::cout << "Failed to load food database; cannot open file: " << path << std::endl;
+		return failure;
+	}
+
+	// First line is a header row
+	std::string header;
+	std::getline(f, header);
+	FoodColumns columns;
+	if (!parse_food_header(header, columns))
+	{
+		return failure;
+	}
+
+	std::unique_ptr<FoodCatalog> result(new FoodCatalog);
+	if (total_weight < 0)
+	{
+		return result;
+	}
+
+	BoundedQueue<FoodStreamChunk> queue(4);
+	bool parsed = false;
+	const uint64_t first_line = f.eof() ? header.size() : header.size() + 1;
+	std::thread parser([&]()
+	{
+		parsed = stream_food_chunks(f, first_line, columns, min_calories, max_calories, total_size, chunk_bytes, queue);
+		queue.close();
+	});
+
+	// However this returns, by an exception too (bad_alloc from the growing
+	// take bitset, say), the parser is stopped and joined first: closing the
+	// queue makes its next push fail, and it then finishes.
+	struct ParserGuard
+	{
+		BoundedQueue<FoodStreamChunk>& queue;
+		std::thread& parser;
+
+		~ParserGuard()
+		{
+			queue.close();
+			if (parser.joinable())
+			{
+				parser.join();
+			}
+		}
+	} guard{queue, parser};
+
+	// The rolling DP of dp_fill_take_bitset, one item at a time, with the
+	// take bitset growing a row per item.
+	const size_t capacity = dp_capacity_units(total_weight, weight_resolution);
+	const size_t words_per_row = capacity / 64 + 1;
+	std::vector<double> row(capacity + 1, 0.0);
+	std::vector<uint64_t> take;
+	std::vector<size_t> weights;
+	std::vector<uint64_t> offsets;
+	size_t limit = 1;
+	for (FoodStreamChunk chunk; queue.pop(chunk); )
+	{
+		for (size_t k = 0; k < chunk.weights.size(); k++)
+		{
+			const size_t w = dp_weight_unit(chunk.weights[k], weight_resolution);
+			weights.push_back(w);
+			offsets.push_back(chunk.offsets[k]);
+			take.resize(take.size() + words_per_row);
+
+			const size_t next = std::min(capacity + 1, limit + w);
+			std::fill(row.begin() + limit, row.begin() + next, row[limit - 1]);
+			limit = next;
+			if (w <= capacity)
+			{
+				dp_row_update(row.data(), row.data(), 0, limit, w, chunk.calories[k], &take[take.size() - words_per_row]);
+			}
+		}
+	}
+	parser.join();
+	if (!parsed)
+	{
+		return failure;
+	}
+
+	FoodIndexVector best;
+	dp_take_traceback(take, words_per_row, weights, capacity, best);
+
+	// Read the chosen lines again for their descriptions.
+	f.clear();
+	std::string line;
+	for (size_t i : best)
+	{
+		const size_t before = result->size();
+		f.seekg(offsets[i]);
+		std::getline(f, line);
+		if (!f || !parse_food_lines(line, 0, *result, columns) || result->size() != before + 1)
+		{
+			std::cout << "Failed to load food database; file changed while solving: " << path << std::endl;
+			return failure;
+		}
+	}
+	return result;
+}
+
+// A second-dimension amount in DP units: quantized like dp_weight_unit, but
+// an item may use none.
+static size_t dp_second_unit(double amount, double resolution)
+{
+	assert(resolution > 0);
+	return amount <= 0 ? 0 : size_t(std::max(0.0, std::ceil(amount / resolution - DP_QUANTIZATION_SLACK)));
+}
+
+// Number of cells of the exact two-constraint DP plane.
+static uint64_t dp_2d_cells(double total_weight, double second_limit, double weight_resolution, double second_resolution)
+{
+	return uint64_t(dp_capacity_units(total_weight, weight_resolution) + 1) * (dp_capacity_units(second_limit, second_resolution) + 1);
+}
+
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_2d
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	const double* second,
+	double second_limit,
+	double weight_resolution,
+	double second_resolution
+)
+{
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+	if (total_weight < 0 || second_limit < 0)
+	{
+		return best;
+	}
+
+	const size_t n = foods.size();
+	const size_t capacity = dp_capacity_units(total_weight, weight_resolution);
+	const size_t depth = dp_capacity_units(second_limit, second_resolution) + 1;
+	const size_t words_per_item = ((capacity + 1) * depth) / 64 + 1;
+	const std::vector<size_t> weights = dp_weight_units(foods, weight_resolution);
+	std::vector<size_t> amounts(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		amounts[i] = dp_second_unit(second[i], second_resolution);
+	}
+
+	// Cell (j, s) of the plane, at j * depth + s, holds the best calories
+	// within weight j and second amount s.
+	std::vector<double> plane((capacity + 1) * depth, 0.0);
+	std::vector<uint64_t> take(n * words_per_item, 0);
+	const double* calories = foods.calories();
+	for (size_t i = 0; i < n; i++)
+	{
+		const size_t w = weights[i], a = amounts[i];
+		const double c = calories[i];
+
+		// Items that do not fit, or cannot add calories, never improve a cell.
+		if (w > capacity || a >= depth || !(c > 0))
+		{
+			continue;
+		}
+
+		// Row j reads row j - w, which is below it and so not yet updated
+		// for this item.
+		uint64_t* take_item = &take[i * words_per_item];
+		for (size_t j = capacity + 1; j-- > w; )
+		{
+			double* cur = &plane[j * depth];
+			const double* prev = &plane[(j - w) * depth];
+			for (size_t s = depth; s-- > a; )
+			{
+				const double candidate = prev[s - a] + c;
+				if (candidate > cur[s])
+				{
+					cur[s] = candidate;
+					const size_t cell = j * depth + s;
+					take_item[cell / 64] |= uint64_t(1) << (cell % 64);
+				}
+			}
+		}
+	}
+	MAXCALORIE_STATS_ADD(dp_cells, uint64_t(n) * plane.size());
+
+	MAXCALORIE_STATS_SCOPE(traceback_nanoseconds);
+	size_t j = capacity, s = depth - 1;
+	for (size_t i = n; i > 0; i--)
+	{
+		const size_t cell = j * depth + s;
+		if ((take[(i - 1) * words_per_item + cell / 64] >> (cell % 64)) & 1)
+		{
+			best->push_back(i - 1);
+			j -= weights[i - 1];
+			s -= amounts[i - 1];
+		}
+	}
+	return best;
+}
+
+std::unique_ptr<FoodIndexVector> lagrangian_max_calories_2d
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	const double* second,
+	double second_limit,
+	double weight_resolution,
+	double* upper_bound
+)
+{
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+	if (upper_bound)
+	{
+		*upper_bound = 0;
+	}
+	if (total_weight < 0 || second_limit < 0)
+	{
+		return best;
+	}
+
+	const size_t n = foods.size();
+	const double* calories = foods.calories();
+	const size_t capacity = dp_capacity_units(total_weight, weight_resolution);
+	const std::vector<size_t> weights = dp_weight_units(foods, weight_resolution);
+
+	// Solve the weight-only DP with the second amounts priced at lambda, and
+	// keep the result if it fits the second limit and beats the best so far.
+	std::vector<double> priced(n);
+	std::vector<uint64_t> take;
+	std::vector<double> row;
+	FoodIndexVector chosen;
+	double best_calories = -1, bound = INFINITY;
+	auto solve = [&](double lambda)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			priced[i] = calories[i] - lambda * second[i];
+		}
+		const size_t words_per_row = dp_fill_take_bitset(weights, priced.data(), capacity, take, row);
+		bound = std::min(bound, row[capacity] + lambda * second_limit);
+
+		chosen.clear();
+		dp_take_traceback(take, words_per_row, weights, capacity, chosen);
+		double used = 0, total = 0;
+		for (size_t i : chosen)
+		{
+			used += second[i];
+			total += calories[i];
+		}
+		const bool fits = used <= second_limit;
+		if (fits && total > best_calories)
+		{
+			*best = chosen;
+			best_calories = total;
+		}
+		return fits;
+	};
+
+	// At the largest calories per unit of second, no item that uses any of it
+	// is worth taking, so the set fits.
+	double low = 0, high = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (second[i] > 0 && calories[i] > 0)
+		{
+			high = std::max(high, calories[i] / second[i]);
+		}
+	}
+	if (!solve(low))
+	{
+		solve(high);
+		for (int iteration = 0; iteration < 30 && high - low > 1e-9 * high; iteration++)
+		{
+			const double middle = (low + high) / 2;
+			(solve(middle) ? high : low) = middle;
+		}
+	}
+
+	// Fill what is left of both limits with the unused items, densest first,
+	// counting each item's share of both limits.
+	std::vector<bool> used(n, false);
+	double weight = 0, amount = 0;
+	for (size_t i : *best)
+	{
+		used[i] = true;
+		weight += foods.weight(i);
+		amount += second[i];
+	}
+	FoodIndexVector rest;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!used[i] && calories[i] > 0)
+		{
+			rest.push_back(i);
+		}
+	}
+	auto share = [&](size_t i)
+	{
+		return foods.weight(i) / std::max(total_weight, 1e-300) + second[i] / std::max(second_limit, 1e-300);
+	};
+	std::sort(rest.begin(), rest.end(), [&](size_t x, size_t y) { return calories[x] * share(y) > calories[y] * share(x); });
+	for (size_t i : rest)
+	{
+		if (weight + foods.weight(i) <= total_weight && amount + second[i] <= second_limit)
+		{
+			best->push_back(i);
+			weight += foods.weight(i);
+			amount += second[i];
+		}
+	}
+
+	std::sort(best->begin(), best->end(), std::greater<size_t>());
+	if (upper_bound)
+	{
+		*upper_bound = bound;
+	}
+	return best;
+}
+
+std::unique_ptr<FoodIndexVector> max_calories_2d
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	const double* second,
+	double second_limit,
+	double weight_resolution,
+	double second_resolution
+)
+{
+	if (total_weight >= 0 && second_limit >= 0)
+	{
+		// The plane alone can be too big even for one item, so it is checked
+		// first, which also keeps the bitset product from overflowing.
+		const uint64_t cells = dp_2d_cells(total_weight, second_limit, weight_resolution, second_resolution);
+		const uint64_t plane_bytes = cells * sizeof(double);
+		if (plane_bytes > DP_2D_MAX_BYTES || foods.size() * (cells / 8 + 8) > DP_2D_MAX_BYTES - plane_bytes)
+		{
+			return lagrangian_max_calories_2d(foods, total_weight, second, second_limit, weight_resolution);
+		}
+		return dynamic_max_calories_2d(foods, total_weight, second, second_limit, weight_resolution, second_resolution);
+	}
+	return lagrangian_max_calories_2d(foods, total_weight, second, second_limit, weight_resolution);
+}
+
+std::unique_ptr<FoodQuantityVector> bounded_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution
+)
+{
+	std::unique_ptr<FoodQuantityVector> best(new FoodQuantityVector);
+
+	if (total_weight < 0)
+	{
+		return best;
+	}
+
+	const size_t capacity = dp_capacity_units(total_weight, weight_resolution);
+
+	// Pseudo-item k is piece_counts[k] units of item piece_items[k].
+	std::vector<size_t> piece_weights, piece_items;
+	std::vector<double> piece_calories;
+	std::vector<uint32_t> piece_counts;
+	for (size_t i = 0; i < foods.size(); i++)
+	{
+		const size_t unit = dp_weight_unit(foods.weight(i), weight_resolution);
+		size_t remaining = std::min<size_t>(foods.quantity(i), capacity / unit);
+		for (size_t piece = 1; remaining > 0; piece *= 2)
+		{
+			const size_t count = std::min(piece, remaining);
+			piece_weights.push_back(count * unit);
+			piece_calories.push_back(count * foods.foodCalories(i));
+			piece_items.push_back(i);
+			piece_counts.push_back(uint32_t(count));
+			remaining -= count;
+		}
+	}
+
+	std::vector<uint64_t> take;
+	std::vector<double> row;
+	const size_t words_per_row = dp_fill_take_bitset(piece_weights, piece_calories.data(), capacity, take, row);
+	FoodIndexVector pieces;
+	dp_take_traceback(take, words_per_row, piece_weights, capacity, pieces);
+
+	// The traceback runs from the last piece down, so reversing it groups
+	// each item's pieces in ascending item order.
+	for (auto k = pieces.rbegin(); k != pieces.rend(); ++k)
+	{
+		if (!best->empty() && best->back().index == piece_items[*k])
+		{
+			best->back().count += piece_counts[*k];
+		}
+		else
+		{
+			best->push_back(FoodQuantity{piece_items[*k], piece_counts[*k]});
+		}
+	}
+	return best;
+}
+
+std::unique_ptr<FoodVector> bounded_max_calories
+(
+	const FoodVector& foods,
+	double total_weight,
+	double weight_resolution
+)
+{
+	FoodCatalog catalog(foods);
+	std::unique_ptr<FoodQuantityVector> best = bounded_max_calories(catalog, total_weight, weight_resolution);
+	std::unique_ptr<FoodVector> result(new FoodVector);
+	for (const FoodQuantity& chosen : *best)
+	{
+		result->insert(result->end(), chosen.count, foods[chosen.index]);
+	}
+	return result;
+}
+
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_parallel
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	ThreadPool& pool,
+	double weight_resolution
+)
+{
+	if (total_weight < 0)
+	{
+		return std::unique_ptr<FoodIndexVector>(new FoodIndexVector);
+	}
+
+	const size_t n = foods.size();
+	const size_t capacity = dp_capacity_units(total_weight, weight_resolution);
+	const size_t width = capacity + 1;
+	const size_t blocks = (width + DP_PARALLEL_BLOCK_COLUMNS - 1) / DP_PARALLEL_BLOCK_COLUMNS;
+	const unsigned threads = unsigned(std::min<size_t>(pool.size(), blocks));
+	if (threads <= 1)
+	{
+		return dynamic_max_calories_rolling(foods, total_weight, weight_resolution);
+	}
+
+	const std::vector<size_t> weights = dp_weight_units(foods, weight_resolution);
+	const double* calories = foods.calories();
+
+	const size_t words_per_row = capacity / 64 + 1;
+	std::vector<uint64_t> take;
+	std::vector<double> first, second;
+	assign_scratch(take, n * words_per_row, uint64_t(0));
+	assign_scratch(first, width, 0.0);
+	assign_scratch(second, width, 0.0);
+	SpinBarrier barrier(threads);
+
+	pool.run([&](unsigned t)
+	{
+		if (t >= threads)
+		{
+			return;
+		}
+
+		const size_t lo = std::min(width, blocks * t / threads * DP_PARALLEL_BLOCK_COLUMNS);
+		const size_t hi = std::min(width, blocks * (t + 1) / threads * DP_PARALLEL_BLOCK_COLUMNS);
+		double* prev = first.data();
+		double* cur = second.data();
+
+		for (size_t i = 0; i < n; i++)
+		{
+			// Every thread skips the same items, so they stay in step.
+			if (weights[i] > capacity)
+			{
+				continue;
+			}
+
+			dp_row_update(prev, cur, lo, hi, weights[i], calories[i], &take[i * words_per_row]);
+			barrier.wait();
+			std::swap(prev, cur);
+		}
+	});
+
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+	dp_take_traceback(take, words_per_row, weights, capacity, *best);
+	return best;
+}
+
+std::unique_ptr<FoodVector> dynamic_max_calories_parallel
+(
+	const FoodVector& foods,
+	double total_weight,
+	ThreadPool& pool,
+	double weight_resolution
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *dynamic_max_calories_parallel(catalog, total_weight, pool, weight_resolution));
+}
+
+void linear_memory_row
+(
+	const double* calories,
+	const std::vector<size_t>& weights,
+	size_t lo,
+	size_t hi,
+	std::vector<double>& row
+)
+{
+	const size_t capacity = row.size() - 1;
+	std::fill(row.begin(), row.end(), 0);
+
+	for (size_t i = lo; i < hi; i++)
+	{
+		const size_t w = weights[i];
+		if (w > capacity)
+		{
+			continue;
+		}
+
+		dp_row_update(row.data(), row.data(), 0, capacity + 1, w, calories[i]);
+	}
+}
+
+void linear_memory_select
+(
+	const double* calories,
+	const std::vector<size_t>& weights,
+	size_t lo,
+	size_t hi,
+	size_t capacity,
+	FoodIndexVector& best
+)
+{
+	if (lo >= hi)
+	{
+		return;
+	}
+
+	if (hi - lo == 1)
+	{
+		if (weights[lo] <= capacity && calories[lo] > 0)
+		{
+			best.push_back(lo);
+		}
+		return;
+	}
+
+	const size_t mid = lo + (hi - lo) / 2;
+	size_t front_capacity = 0;
+	{
+		std::vector<double> front(capacity + 1), back(capacity + 1);
+		linear_memory_row(calories, weights, lo, mid, front);
+		linear_memory_row(calories, weights, mid, hi, back);
+
+		double best_calories = -1;
+		for (size_t k = 0; k <= capacity; k++)
+		{
+			double total = front[k] + back[capacity - k];
+			if (total > best_calories)
+			{
+				best_calories = total;
+				front_capacity = k;
+			}
+		}
+	}
+
+	// Upper half first, to keep the traceback order of dynamic_max_calories.
+	linear_memory_select(calories, weights, mid, hi, capacity - front_capacity, best);
+	linear_memory_select(calories, weights, lo, mid, front_capacity, best);
+}
+
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_linear_memory
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution
+)
+{
+	std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+
+	if (total_weight < 0)
+	{
+		return best;
+	}
+
+	linear_memory_select(
+		foods.calories(),
+		dp_weight_units(foods, weight_resolution),
+		0,
+		foods.size(),
+		dp_capacity_units(total_weight, weight_resolution),
+		*best
+	);
+
+	return best;
+}
+
+std::unique_ptr<FoodVector> dynamic_max_calories_linear_memory
+(
+	const FoodVector& foods,
+	double total_weight,
+	double weight_resolution
+)
+{
+	FoodCatalog catalog(foods);
+	return select_food_vector(foods, *dynamic_max_calories_linear_memory(catalog, total_weight, weight_resolution));
+}
+
+const char* choose_solver
+(
+	size_t n,
+	double total_weight,
+	double weight_resolution,
+	double seconds_left
+)
+{
+	const double capacity = dp_capacity_units(std::max(total_weight, 0.0), weight_resolution);
+	const char* best = nullptr;
+	double best_seconds = INFINITY;
+	auto consider = [&](const char* solver, double seconds)
+	{
+		if (seconds < best_seconds)
+		{
+			best = solver;
+			best_seconds = seconds;
+		}
+	};
+
+	if (n < 64)
+	{
+		consider("exhaustive", std::ldexp(SOLVE_SECONDS_PER_SUBSET, int(n)));
+		if (std::ldexp(24.0, int((n + 1) / 2)) <= SOLVE_MAX_EXACT_BYTES)
+		{
+			consider("mitm", std::ldexp(SOLVE_SECONDS_PER_MITM_STEP * n, int((n + 1) / 2)));
+		}
+	}
+	if (n * (capacity / 64 + 1) * sizeof(uint64_t) <= SOLVE_MAX_EXACT_BYTES)
+	{
+		consider("dynamic", SOLVE_SECONDS_PER_DP_CELL * n * (capacity + 1));
+	}
+
+	if (best && best_seconds <= std::min(seconds_left, SOLVE_MAX_EXACT_SECONDS))
+	{
+		return best;
+	}
+	return SOLVE_SECONDS_PER_GREEDY_ITEM * n < seconds_left ? "branch_bound" : "greedy";
+}
+
+SolveResult solve_request(const SolveRequest& request)
+{
+	SolveResult result;
+	SolverWorkspace& workspace = thread_solver_workspace();
+	if (!request.catalog || !filter_food_catalog(*request.catalog, request.min_calories, request.max_calories, request.total_size, workspace.indices))
+	{
+		return result;
+	}
+	const FoodCatalog& foods = workspace.catalog;
+	request.catalog->subset(workspace.indices, workspace.catalog);
+	result.best.reset(new FoodIndexVector);
+	if (request.total_weight < 0)
+	{
+		result.solver = "greedy";
+		result.optimal = true;
+		return result;
+	}
+
+	// The fallback.
+	double upper_bound;
+	greedy_max_calories(foods, request.total_weight, workspace, *result.best, &upper_bound);
+	result.solver = "greedy";
+	sum_food_catalog(foods, *result.best, result.weight, result.calories);
+	result.optimal = result.calories >= upper_bound;
+
+	std::chrono::duration<double> left = request.deadline - std::chrono::steady_clock::now();
+	const double seconds_left = request.deadline == NO_SOLVER_DEADLINE ? INFINITY : left.count();
+	const char* solver = result.optimal ? "greedy"
+		: request.solver ? request.solver
+		: choose_solver(foods.size(), request.total_weight, request.weight_resolution, seconds_left);
+
+	// An exact solver that runs out of time leaves best null.
+	std::unique_ptr<FoodIndexVector> best;
+	bool optimal = true;
+	if (std::string_view(solver) == "exhaustive")
+	{
+		best.reset(new FoodIndexVector);
+		if (!exhaustive_max_calories_gray(foods, request.total_weight, *best, request.deadline))
+		{
+			best.reset();
+		}
+	}
+	else if (std::string_view(solver) == "mitm")
+	{
+		best = mitm_max_calories(foods, request.total_weight, request.deadline);
+	}
+	else if (std::string_view(solver) == "dynamic")
+	{
+		best.reset(new FoodIndexVector);
+		if (!dynamic_max_calories_rolling(foods, request.total_weight, workspace, *best, request.weight_resolution, request.deadline))
+		{
+			best.reset();
+		}
+	}
+	else if (std::string_view(solver) == "branch_bound")
+	{
+		// max_seconds = 0 would mean no limit, so a deadline already past
+		// still gets a tiny positive one.
+		BranchBoundLimits limits;
+		limits.max_seconds = std::max(seconds_left, 1e-9);
+		BranchBoundStats stats;
+		best = branch_bound_max_calories(foods, request.total_weight, limits, &stats);
+		optimal = stats.optimal;
+	}
+
+	if (best)
+	{
+		double weight, calories;
+		sum_food_catalog(foods, *best, weight, calories);
+		// A DP over coarse weight units can lose to the greedy answer.
+		if (calories > result.calories || (optimal && calories >= result.calories))
+		{
+			*result.best = *best;
+			result.weight = weight;
+			result.calories = calories;
+			result.solver = solver;
+			result.optimal = optimal;
+		}
+	}
+
+	remap_food_indices(workspace.indices, *result.best);
+	std::sort(result.best->begin(), result.best->end());
+	return result;
+}
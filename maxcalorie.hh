@@ -4,22 +4,46 @@
 // Compute the set of foods that maximizes the calories in foods, within
 // a given maximum weight with the dynamic programming or exhaustive search.
 //
+// The functions are defined in maxcalorie.cc; the classes and the DP row
+// kernel templates are defined here.
+//
 ///////////////////////////////////////////////////////////////////////////////
 
 
 #pragma once
 
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "threadpool.hh"
+#include "timer.hh"
+
+// The DP row kernels have AVX2 versions on x86 with GCC or Clang.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MAXCALORIE_AVX2_KERNELS 1
+#endif
+
 
 // One food item available for purchase.
 class FoodItem
@@ -32,21 +56,33 @@ class FoodItem
 		(
 			const std::string& description,
 			double weight_ounces,
-			double calories
+			double calories,
+			uint32_t quantity = 1,
+			double volume = 0,
+			double cost = 0
 		)
 			:
 			_description(description),
 			_weight_ounces(weight_ounces),
-			_calories(calories)
+			_calories(calories),
+			_quantity(quantity),
+			_volume(volume),
+			_cost(cost)
 		{
 			assert(!description.empty());
 			assert(weight_ounces > 0);
+			assert(quantity > 0);
+			assert(volume >= 0);
+			assert(cost >= 0);
 		}
 
 		//
 		const std::string& description() const { return _description; }
 		double weight() const { return _weight_ounces; }
 		double foodCalories() const { return _calories; }
+		uint32_t quantity() const { return _quantity; }
+		double volume() const { return _volume; }
+		double cost() const { return _cost; }
 
 	//
 	private:
@@ -59,6 +95,17 @@ class FoodItem
 
 		// Calories; most be non-negative.
 		double _calories;
+
+		// Number of units in stock, each of the weight and calories above.
+		// Must be positive. Only bounded_max_calories takes more than one;
+		// the other solvers treat every item as a single unit.
+		uint32_t _quantity;
+
+		// Volume, in whatever unit the database uses, and price; both
+		// non-negative, and 0 when the database has no such column. Only the
+		// two-constraint solvers (max_calories_2d) look at them.
+		double _volume;
+		double _cost;
 };
 
 
@@ -66,92 +113,403 @@ class FoodItem
 typedef std::vector<std::shared_ptr<FoodItem>> FoodVector;
 
 
-// Load all the valid food items from the CSV database
-// Food items that are missing fields, or have invalid values, are skipped.
-// Returns nullptr on I/O error.
-std::unique_ptr<FoodVector> load_food_database(const std::string& path)
+// Alias for a list of positions of food items in a FoodCatalog (or, through
+// select_food_vector, in a FoodVector).
+typedef std::vector<size_t> FoodIndexVector;
+
+
+// A collection of food items stored as a structure of arrays.
+// Weights and calories live in contiguous arrays, so the solvers can scan
+// them without chasing a pointer per item, and every description is a slice
+// of one shared string pool. Items are addressed by their position, and the
+// solvers that take a FoodCatalog return FoodIndexVectors of positions
+// instead of copies of the items.
+class FoodCatalog
 {
-	std::unique_ptr<FoodVector> failure(nullptr);
+	//
+	public:
 
-	std::ifstream f(path);
-	if (!f)
-	{
-		std::cout << "Failed to load food database; cannot open file: " << path << std::endl;
-		return failure;
-	}
+		// Create an empty catalog.
+		FoodCatalog()
+		{
+			_description_offsets.push_back(0);
+		}
 
-	std::unique_ptr<FoodVector> result(new FoodVector);
+		// Copy the items of a FoodVector, keeping their order.
+		explicit FoodCatalog(const FoodVector& foods)
+			:
+			FoodCatalog()
+		{
+			size_t description_bytes = 0;
+			for (auto& food : foods)
+			{
+				description_bytes += food->description().size();
+			}
+			reserve(foods.size(), description_bytes);
 
-	size_t line_number = 0;
-	for (std::string line; std::getline(f, line); )
-	{
-		line_number++;
+			for (auto& food : foods)
+			{
+				push_back(food->description(), food->weight(), food->foodCalories(), food->quantity(), food->volume(), food->cost());
+			}
+		}
 
-		// First line is a header row
-		if ( line_number == 1 )
+		// Remove every item, keeping the allocated storage for reuse.
+		void clear()
 		{
-			continue;
+			_weights.clear();
+			_calories.clear();
+			_quantities.clear();
+			_volumes.clear();
+			_costs.clear();
+			_description_offsets.assign(1, 0);
+			_description_pool.clear();
+			_content_hash = HASH_BASIS;
+		}
+
+		// Append every item of other, in order, as if by push_back.
+		void append(const FoodCatalog& other)
+		{
+			assert(&other != this);
+			const size_t pool_bytes = _description_pool.size();
+			_weights.insert(_weights.end(), other._weights.begin(), other._weights.end());
+			_calories.insert(_calories.end(), other._calories.begin(), other._calories.end());
+			_quantities.insert(_quantities.end(), other._quantities.begin(), other._quantities.end());
+			_volumes.insert(_volumes.end(), other._volumes.begin(), other._volumes.end());
+			_costs.insert(_costs.end(), other._costs.begin(), other._costs.end());
+			for (size_t k = 1; k < other._description_offsets.size(); k++)
+			{
+				_description_offsets.push_back(pool_bytes + other._description_offsets[k]);
+			}
+			_description_pool += other._description_pool;
+
+			// See content_hash: the items of other are shifted up by their count.
+			uint64_t shift = 1, power = HASH_MULTIPLIER;
+			for (size_t m = other.size(); m > 0; m /= 2)
+			{
+				if (m & 1)
+				{
+					shift *= power;
+				}
+				power *= power;
+			}
+			_content_hash = (_content_hash - HASH_BASIS) * shift + other._content_hash;
 		}
 
-		std::vector<std::string> fields;
-		std::stringstream ss(line);
+		// Reserve room for a number of items and description bytes.
+		void reserve(size_t items, size_t description_bytes)
+		{
+			_weights.reserve(items);
+			_calories.reserve(items);
+			_quantities.reserve(items);
+			_volumes.reserve(items);
+			_costs.reserve(items);
+			_description_offsets.reserve(items + 1);
+			_description_pool.reserve(description_bytes);
+		}
 
-		for (std::string field; std::getline(ss, field, '^'); )
+		// Append one item. Same requirements as the FoodItem constructor.
+		void push_back
+		(
+			std::string_view description,
+			double weight_ounces,
+			double calories,
+			uint32_t quantity = 1,
+			double volume = 0,
+			double cost = 0
+		)
 		{
-			fields.push_back(field);
+			assert(!description.empty());
+			assert(weight_ounces > 0);
+			assert(quantity > 0);
+			assert(volume >= 0);
+			assert(cost >= 0);
+
+			_description_pool.append(description.data(), description.size());
+			_description_offsets.push_back(_description_pool.size());
+			_weights.push_back(weight_ounces);
+			_calories.push_back(calories);
+			_quantities.push_back(quantity);
+			_volumes.push_back(volume);
+			_costs.push_back(cost);
+
+			// FNV-1a over the description, a separator and the five values.
+			uint64_t item_hash = HASH_BASIS;
+			auto mix = [&item_hash](const char* bytes, size_t count)
+			{
+				for (size_t k = 0; k < count; k++)
+				{
+					item_hash = (item_hash ^ uint8_t(bytes[k])) * 0x100000001b3ULL;
+				}
+			};
+			mix(description.data(), description.size());
+			mix("", 1);
+			mix(reinterpret_cast<const char*>(&weight_ounces), sizeof(weight_ounces));
+			mix(reinterpret_cast<const char*>(&calories), sizeof(calories));
+			mix(reinterpret_cast<const char*>(&quantity), sizeof(quantity));
+			mix(reinterpret_cast<const char*>(&volume), sizeof(volume));
+			mix(reinterpret_cast<const char*>(&cost), sizeof(cost));
+			_content_hash = _content_hash * HASH_MULTIPLIER + item_hash;
 		}
 
-		if (fields.size() != 3)
+		//
+		size_t size() const { return _weights.size(); }
+		bool empty() const { return _weights.empty(); }
+
+		//
+		std::string_view description(size_t i) const
 		{
-			std::cout
-				<< "Failed to load food database: Invalid field count at line " << line_number << "; Want 3 but got " << fields.size() << std::endl
-				<< "Line: " << line << std::endl
-				;
-			return failure;
+			assert(i < size());
+			return std::string_view(
+				_description_pool.data() + _description_offsets[i],
+				_description_offsets[i + 1] - _description_offsets[i]
+			);
 		}
+		double weight(size_t i) const { return _weights[i]; }
+		double foodCalories(size_t i) const { return _calories[i]; }
+		uint32_t quantity(size_t i) const { return _quantities[i]; }
+		double volume(size_t i) const { return _volumes[i]; }
+		double cost(size_t i) const { return _costs[i]; }
+
+		// Hash of the catalog's contents (every item, in order), kept up to
+		// date by push_back. Equal catalogs have equal hashes, so it can key
+		// caches of solver results. It is a polynomial in HASH_MULTIPLIER of
+		// the items' FNV-1a hashes, HASH_BASIS * K^n + h_0 * K^(n-1) + ... +
+		// h_(n-1) (mod 2^64), so append can combine two catalogs' hashes
+		// without rehashing either.
+		uint64_t content_hash() const { return _content_hash; }
+
+		// Contiguous arrays of all the weights and calories, size() long.
+		const double* weights() const { return _weights.data(); }
+		const double* calories() const { return _calories.data(); }
+		const uint32_t* quantities() const { return _quantities.data(); }
+		const double* volumes() const { return _volumes.data(); }
+		const double* costs() const { return _costs.data(); }
 
-		std::string
-			descr_field = fields[0],
-			weight_ounces_field = fields[1],
-			calories_field = fields[2]
-			;
+		// Return a new catalog holding the given items, in the given order.
+		// Position k of the result is position indices[k] of this catalog; see
+		// remap_food_indices.
+		FoodCatalog subset(const FoodIndexVector& indices) const
+		{
+			FoodCatalog result;
+			subset(indices, result);
+			return result;
+		}
 
-		auto parse_dbl = [](const std::string& field, double& output)
+		// Same as above, replacing the contents of result, whose storage is
+		// reused; result must not be this catalog.
+		void subset(const FoodIndexVector& indices, FoodCatalog& result) const
 		{
-			std::stringstream ss(field);
-			if ( ! ss )
+			assert(&result != this);
+			result.clear();
+			size_t description_bytes = 0;
+			for (size_t i : indices)
 			{
-				return false;
+				description_bytes += _description_offsets[i + 1] - _description_offsets[i];
 			}
+			result.reserve(indices.size(), description_bytes);
 
-			ss >> output;
-
-			return true;
-		};
+			for (size_t i : indices)
+			{
+				result.push_back(description(i), _weights[i], _calories[i], _quantities[i], _volumes[i], _costs[i]);
+			}
+		}
 
-		std::string description(descr_field);
-		double weight_ounces, calories;
-		if (
-			parse_dbl(weight_ounces_field, weight_ounces)
-			&& parse_dbl(calories_field, calories)
-		)
+		// Create a FoodVector of new FoodItems for the given items, in the
+		// given order.
+		std::unique_ptr<FoodVector> to_food_vector(const FoodIndexVector& indices) const
 		{
-			result->push_back(
-				std::shared_ptr<FoodItem>(
-					new FoodItem(
-						description,
-						weight_ounces,
-						calories
+			std::unique_ptr<FoodVector> result(new FoodVector);
+			result->reserve(indices.size());
+			for (size_t i : indices)
+			{
+				result->push_back(
+					std::shared_ptr<FoodItem>(
+						new FoodItem(
+							std::string(description(i)),
+							_weights[i],
+							_calories[i],
+							_quantities[i],
+							_volumes[i],
+							_costs[i]
+						)
 					)
-				)
-			);
+				);
+			}
+			return result;
 		}
-	}
 
-	f.close();
+		// Create a FoodVector of new FoodItems for every item in the catalog.
+		std::unique_ptr<FoodVector> to_food_vector() const
+		{
+			FoodIndexVector all(size());
+			for (size_t i = 0; i < all.size(); i++)
+			{
+				all[i] = i;
+			}
+			return to_food_vector(all);
+		}
 
-	return result;
-}
+	//
+	private:
+
+		// The snapshot format stores these arrays as they are.
+		friend bool save_food_snapshot(const FoodCatalog&, const std::string&, uint64_t);
+		friend std::unique_ptr<FoodCatalog> load_food_snapshot(const std::string&, uint64_t);
+
+		// Weight in ounces, calories, units in stock, volume and cost of each
+		// item.
+		std::vector<double> _weights;
+		std::vector<double> _calories;
+		std::vector<uint32_t> _quantities;
+		std::vector<double> _volumes;
+		std::vector<double> _costs;
+
+		// Description i is _description_pool[_description_offsets[i], _description_offsets[i + 1]).
+		// Always holds size() + 1 offsets.
+		std::vector<size_t> _description_offsets;
+		std::string _description_pool;
+
+		// See content_hash; starts at the FNV-1a offset basis.
+		static constexpr uint64_t HASH_BASIS = 0xcbf29ce484222325ULL;
+		static constexpr uint64_t HASH_MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+		uint64_t _content_hash = HASH_BASIS;
+};
+
+
+// Column layout of a food database, read from its header row.
+// The first three columns are always the description, the weight and the
+// calories, whatever the header calls them. Any further columns are
+// optional and recognized by name:
+//   Quantity: units in stock, a positive integer (1 without the column).
+//   Volume: volume of one unit, a non-negative number (0 without it).
+//   Cost: price of one unit, a non-negative number (0 without it).
+// Indices are 0 for an absent column.
+struct FoodColumns
+{
+	size_t field_count = 3;
+	size_t quantity = 0;
+	size_t volume = 0;
+	size_t cost = 0;
+};
+
+// Most columns a food database can have.
+const size_t FOOD_MAX_COLUMNS = 6;
+
+// Read the column layout from the header row. Returns false, with a
+// message, on an unknown or repeated optional column.
+bool parse_food_header(std::string_view header, FoodColumns& columns);
+
+// Whether a parsed number is a valid quantity: a positive integer that fits
+// in 32 bits.
+bool is_food_quantity(double value);
+
+// Load all the valid food items from the CSV database
+// Food items that are missing fields, or have invalid values, are skipped.
+// The optional columns are described by FoodColumns.
+// Returns nullptr on I/O error.
+std::unique_ptr<FoodVector> load_food_database(const std::string& path);
+
+
+// Parse one numeric field of the food database with std::from_chars.
+// Surrounding spaces and tabs are ignored. Anything else that is not part of
+// the number, or a value that is not finite, is a parse failure.
+bool parse_food_number(std::string_view field, double& output);
+
+// Parse the data lines (no header) of the food database held in text, and
+// append the valid items to catalog. first_line_number is the line number of
+// the first line of text, for error messages.
+// Same rules as load_food_database: an item with an invalid value is skipped,
+// and a line with the wrong number of fields fails the whole load, in which
+// case this returns false.
+// Fields are split in place; the only copy of a description is the one
+// appended to the catalog's string pool.
+bool parse_food_lines
+(
+	std::string_view text,
+	size_t first_line_number,
+	FoodCatalog& catalog,
+	const FoodColumns& columns = FoodColumns()
+);
+
+// Load all the valid food items from the CSV database straight into a
+// FoodCatalog. This accepts the same files as load_food_database, but reads
+// the whole file into one buffer and parses it in place with
+// std::from_chars, with no per-line streams or per-item allocations.
+// Returns nullptr on I/O error or an invalid field count.
+std::unique_ptr<FoodCatalog> load_food_catalog(const std::string& path);
+
+// Same result as load_food_catalog, parsed by the threads of pool.
+// The file is read into one buffer and cut into one piece per thread, each
+// cut moved forward to the next line boundary. Every thread counts the lines
+// of its piece, so each piece knows its first line number, and then parses it
+// with parse_food_lines into its own catalog segment; the segments are then
+// appended in file order. With an invalid line in more than one piece, more
+// than one message may be printed.
+std::unique_ptr<FoodCatalog> load_food_catalog_parallel(const std::string& path, ThreadPool& pool);
+
+// Header of a binary food catalog snapshot; see save_food_snapshot.
+// The header is followed by the weights (item_count doubles), the calories
+// (item_count doubles), the quantities (item_count uint32s, zero-padded to a
+// multiple of 8 bytes), the volumes and the costs (item_count doubles each),
+// the description offsets (item_count + 1 uint64s) and
+// finally the description pool (pool_bytes chars). Every array starts on an
+// 8-byte boundary, so the file can be mmapped and the arrays used in place.
+struct FoodSnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t item_count;
+	uint64_t pool_bytes;
+	uint64_t source_bytes;
+	uint64_t content_hash;
+};
+
+// Identifies a food snapshot file, and the version of its layout. Bump the
+// version whenever the layout changes; older snapshots are then rejected and
+// rebuilt from the CSV.
+const char FOOD_SNAPSHOT_MAGIC[8] = {'F', 'O', 'O', 'D', 'S', 'N', 'A', 'P'};
+const uint32_t FOOD_SNAPSHOT_VERSION = 5;
+const uint32_t FOOD_SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+// Bytes taken by n quantities in a snapshot, with their padding.
+uint64_t food_snapshot_quantity_bytes(uint64_t n);
+
+// Write catalog to path as a binary snapshot that load_food_snapshot can read
+// back with no parsing. source_bytes records the size of the CSV the catalog
+// came from, so a stale snapshot can be detected; pass 0 if there is none.
+// Returns false on I/O error.
+bool save_food_snapshot
+(
+	const FoodCatalog& catalog,
+	const std::string& path,
+	uint64_t source_bytes = 0
+);
+
+// Load a catalog written by save_food_snapshot. The arrays are read in bulk
+// and the items are not re-validated; only the header and the array sizes
+// are checked. If source_bytes is nonzero, it must match the value the
+// snapshot was saved with.
+// Returns nullptr if the file cannot be read, or is not a snapshot of the
+// current version.
+std::unique_ptr<FoodCatalog> load_food_snapshot
+(
+	const std::string& path,
+	uint64_t source_bytes = 0
+);
+
+// Load the food database at csv_path, going through the binary snapshot at
+// snapshot_path when possible.
+// A snapshot that is newer than the CSV and was made from a CSV of the same
+// size is loaded directly. Otherwise the CSV is parsed with load_food_catalog
+// and a new snapshot is written for next time.
+// Returns nullptr on the same errors as load_food_catalog; failing to write
+// the snapshot is reported but not fatal.
+std::unique_ptr<FoodCatalog> load_food_catalog
+(
+	const std::string& csv_path,
+	const std::string& snapshot_path
+);
 
 
 // Convenience function to compute the total weight and calories in
@@ -164,49 +522,12 @@ void sum_food_vector
 	const FoodVector& foods,
 	double& total_weight,
 	double& total_calories
-)
-{
-	total_weight = total_calories = 0;
-	for (auto& food : foods)
-	{
-		total_weight += food->weight();
-		total_calories += food->foodCalories();
-	}
-}
+);
 
 
 // Convenience function to print out each FoodItem in a FoodVector,
 // followed by the total weight and calories of it.
-void print_food_vector(const FoodVector& foods)
-{
-	std::cout << "*** food Vector ***" << std::endl;
-
-	if ( foods.size() == 0 )
-	{
-		std::cout << "[empty food list]" << std::endl;
-	}
-	else
-	{
-		for (auto& food : foods)
-		{
-			std::cout
-				<< "Ye olde " << food->description()
-				<< " ==> "
-				<< "Weight of " << food->weight() << " ounces"
-				<< "; calories = " << food->foodCalories()
-				<< std::endl
-				;
-		}
-
-		double total_weight, total_calories;
-		sum_food_vector(foods, total_weight, total_calories);
-		std::cout
-			<< "> Grand total weight: " << total_weight << " ounces" << std::endl
-			<< "> Grand total calories: " << total_calories
-			<< std::endl
-			;
-	}
-}
+void print_food_vector(const FoodVector& foods);
 
 
 // Filter the vector source, i.e. create and return a new FoodVector
@@ -229,166 +550,1673 @@ std::unique_ptr<FoodVector> filter_food_vector
 	double min_calories,
 	double max_calories,
 	int total_size
-)
+);
+
+// Thin adapter from solver results back to the FoodVector API: return a new
+// FoodVector with foods[i] for each i in indices, in order. The items are
+// shared with foods, not copied.
+std::unique_ptr<FoodVector> select_food_vector
+(
+	const FoodVector& foods,
+	const FoodIndexVector& indices
+);
+
+// Rewrite indices into a subset of a catalog (see FoodCatalog::subset) as
+// indices into the catalog it was taken from. parent_indices is the list the
+// subset was made from.
+void remap_food_indices
+(
+	const FoodIndexVector& parent_indices,
+	FoodIndexVector& indices
+);
+
+// Compute the total weight and calories of the given items of a
+// FoodCatalog, like sum_food_vector.
+void sum_food_catalog
+(
+	const FoodCatalog& catalog,
+	const FoodIndexVector& indices,
+	double& total_weight,
+	double& total_calories
+);
+
+// Same as filter_food_vector, but over a FoodCatalog: write to filtered the
+// positions of the first total_size items whose calories are between
+// min_calories and max_calories (inclusive), in catalog order. The storage
+// of filtered is reused. Returns false, leaving filtered empty, for an
+// invalid total_size.
+bool filter_food_catalog
+(
+	const FoodCatalog& catalog,
+	double min_calories,
+	double max_calories,
+	int total_size,
+	FoodIndexVector& filtered
+);
+
+// Same as above, into a new vector; nullptr for an invalid total_size.
+std::unique_ptr<FoodIndexVector> filter_food_catalog
+(
+	const FoodCatalog& catalog,
+	double min_calories,
+	double max_calories,
+	int total_size
+);
+
+// Same result as filter_food_catalog, scanned by the threads of pool.
+// Each thread collects the matches of its own contiguous range of the
+// catalog, stopping once it has total_size of them, since those are all
+// that could be kept; the ranges are then joined in order and cut to the
+// first total_size.
+bool filter_food_catalog_parallel
+(
+	const FoodCatalog& catalog,
+	double min_calories,
+	double max_calories,
+	int total_size,
+	ThreadPool& pool,
+	FoodIndexVector& filtered
+);
+
+// Scratch memory for the solvers, reused across calls.
+// The overloads that take a SolverWorkspace keep their DP rows, tables,
+// bitsets and sort orders here instead of allocating them, and write their
+// result into a caller-owned vector. The vectors only ever grow, so once a
+// workspace has seen the largest problem of a loop, solving in that loop
+// allocates nothing. The indices, catalog and best members are not used by
+// the solvers; they are there for the caller's filtered positions, subset
+// and results. A workspace must not be shared between threads; see
+// thread_solver_workspace.
+struct SolverWorkspace
 {
-	if(total_size <= 0)
-	{
-		std::cout << "invalid total size\n";
-		return nullptr;
-	}
+	// Solver scratch.
+	std::vector<size_t> units;
+	std::vector<uint64_t> take;
+	std::vector<double> row;
+	std::vector<double> table;
+	std::vector<uint32_t> row32, calories32;
+	std::vector<uint64_t> row64, calories64;
+	std::vector<size_t> limits;
+	FoodIndexVector order;
+	FoodIndexVector candidate;
 
-	// Initialize the vector that will hold the filtered items.
-	std::unique_ptr<FoodVector> FilteredFoodVector(new FoodVector);
+	// Caller buffers.
+	FoodIndexVector indices;
+	FoodCatalog catalog;
+	FoodIndexVector best;
+	std::vector<FoodIndexVector> results;
+};
 
-	// Loop to go through all the items in the food vector.
-	for(auto& food: source)
-	{
-		// If the item satisfies the requirements of the minimum calories, maximum
-		// calories and within the size constraints, it will be added to our filtered
-		// vector.
-		if (food->foodCalories() >= min_calories && food->foodCalories() <= max_calories)
+// The calling thread's own workspace.
+SolverWorkspace& thread_solver_workspace();
+
+// Counts of the items removed by prune_dominated_items.
+struct PruneStats
+{
+	size_t input_items = 0;
+	size_t kept_items = 0;
+	size_t over_capacity = 0;	// heavier than total_weight
+	size_t no_calories = 0;		// calories <= 0, never worth taking
+	size_t dominated = 0;		// outside the top floor(total_weight / w) of their weight
+};
+
+// Return, in catalog order, the positions of the items that can still
+// matter to an optimal 0/1 choice within total_weight.
+// At most k = floor(total_weight / w) items of weight w fit in any solution,
+// and swapping a chosen item for an unchosen one of the same weight but more
+// calories never hurts, so among items of equal weight only the k with the
+// most calories (ties to the earliest) are kept. Items that cannot fit or
+// add no calories are dropped too. Solving the kept items with any of the
+// exact solvers gives the same total calories as solving all of them.
+std::unique_ptr<FoodIndexVector> prune_dominated_items
+(
+	const FoodCatalog& catalog,
+	double total_weight,
+	PruneStats* stats = nullptr
+);
+
+// Same as above, but over a FoodVector, returning the kept items.
+std::unique_ptr<FoodVector> prune_dominated_items
+(
+	const FoodVector& foods,
+	double total_weight,
+	PruneStats* stats = nullptr
+);
+
+// A read-only view of a run of catalog positions, owned by someone else.
+struct FoodIndexSpan
+{
+	const size_t* first = nullptr;
+	const size_t* last = nullptr;
+
+	const size_t* begin() const { return first; }
+	const size_t* end() const { return last; }
+	size_t size() const { return last - first; }
+	bool empty() const { return first == last; }
+	size_t operator[](size_t i) const { assert(i < size()); return first[i]; }
+};
+
+// An index of a FoodCatalog ordered by calories, answering the range
+// queries of filter_food_catalog without scanning every item.
+// The index refers to the catalog, which must outlive it and must not be
+// added to afterwards.
+class FoodCalorieIndex
+{
+	//
+	public:
+
+		//
+		explicit FoodCalorieIndex(const FoodCatalog& catalog)
+			:
+			_catalog(catalog),
+			_positions(catalog.size()),
+			_sorted_calories(catalog.size())
 		{
-			if (int(FilteredFoodVector->size()) < total_size)
+			const double* calories = catalog.calories();
+			for (size_t i = 0; i < _positions.size(); i++)
+			{
+				_positions[i] = i;
+			}
+			// Stable, so equal calories stay in catalog order.
+			std::stable_sort(_positions.begin(), _positions.end(),
+				[calories](size_t a, size_t b) { return calories[a] < calories[b]; });
+			for (size_t k = 0; k < _positions.size(); k++)
 			{
-				FilteredFoodVector->push_back(food);
+				_sorted_calories[k] = calories[_positions[k]];
 			}
+		}
 
-			// If we have filled up our vector, we will just break out the loop.
-			else
+		//
+		const FoodCatalog& catalog() const { return _catalog; }
+
+		// Positions of all the items whose calories are between min_calories
+		// and max_calories (inclusive), ordered by calories, then position.
+		// The span stays valid as long as the index.
+		FoodIndexSpan range(double min_calories, double max_calories) const
+		{
+			FoodIndexSpan span;
+			span.first = span.last = _positions.data();
+			if (!(min_calories <= max_calories))
 			{
-				break;
+				return span;
 			}
+			auto lo = std::lower_bound(_sorted_calories.begin(), _sorted_calories.end(), min_calories);
+			auto hi = std::upper_bound(lo, _sorted_calories.end(), max_calories);
+			span.first = _positions.data() + (lo - _sorted_calories.begin());
+			span.last = _positions.data() + (hi - _sorted_calories.begin());
+			return span;
 		}
-	}
 
-	// Return the vector with the filtered items
-	return FilteredFoodVector;
-}
+		// Same result as filter_food_catalog(catalog(), min_calories,
+		// max_calories, total_size): the first total_size matching positions
+		// in catalog order.
+		// When matches are so common that a scan would stop early, after
+		// about total_size * size / matches items, scan instead; otherwise
+		// select the total_size smallest positions out of the range.
+		std::unique_ptr<FoodIndexVector> filter
+		(
+			double min_calories,
+			double max_calories,
+			int total_size
+		) const
+		{
+			if(total_size <= 0)
+			{
+				std::cout << "invalid total size\n";
+				return nullptr;
+			}
+
+			FoodIndexSpan matches = range(min_calories, max_calories);
+			const size_t wanted = std::min(size_t(total_size), matches.size());
+			if (matches.size() > 0 && double(wanted) * _positions.size() < double(matches.size()) * matches.size())
+			{
+				return filter_food_catalog(_catalog, min_calories, max_calories, total_size);
+			}
+
+			std::unique_ptr<FoodIndexVector> filtered(new FoodIndexVector(matches.begin(), matches.end()));
+			if (wanted < filtered->size())
+			{
+				std::nth_element(filtered->begin(), filtered->begin() + wanted, filtered->end());
+				filtered->resize(wanted);
+			}
+			std::sort(filtered->begin(), filtered->end());
+			return filtered;
+		}
+
+	//
+	private:
+
+		const FoodCatalog& _catalog;
+
+		// Catalog positions sorted by calories, and their calories alongside
+		// for the binary searches.
+		std::vector<size_t> _positions;
+		std::vector<double> _sorted_calories;
+};
 
 // Compute the optimal set of food items with a exhaustive search algorithm.
 // Specifically, among all subsets of food items, return the subset
 // whose weight in ounces fits within the total_weight one can carry and
 // whose total calories is greatest.
 // To avoid overflow, the size of the food items vector must be less than 64.
+// Writes positions in the catalog to BestFoodVector, in ascending order.
+void exhaustive_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& BestFoodVector
+);
+
+// Same as above, allocating its own scratch and result.
+std::unique_ptr<FoodIndexVector> exhaustive_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight
+);
+
+// FoodVector adapter for exhaustive_max_calories.
 std::unique_ptr<FoodVector> exhaustive_max_calories
 (
 	const FoodVector& foods,
 	double total_weight
-)
-{
-	const int n = foods.size();
-	assert(n < 64);
-	std::unique_ptr<FoodVector> BestFoodVector(new FoodVector);
-	std::unique_ptr<FoodVector> CandidateFoodVector(new FoodVector(foods));
-
-	// We will Initialize what we need for our loop and the weights and calories.
-	int bitSize = pow(2, foods.size());
-	double bestTotalCalries = 0;
-	double candTotalWeight = 0;
-	double candTotalCalories = 0;
-
-	for (int bit = 0; bit < bitSize; bit++)
-	{
-		// We will keep clearing this vector to get ready for the next candidate.
-		// We also set the candidate weight and calorie back to 0.
-		CandidateFoodVector->clear();
-		candTotalWeight = 0;
-		candTotalCalories = 0;
-		for (int j = 0; j < int(foods.size()); j++)
-		{
-			if (((bit >> j) & 1) == 1)
-			{
-				// Adding elements to our candidate vector.
-				CandidateFoodVector->push_back(foods[j]);
-				candTotalWeight += foods[j]->weight();
-				candTotalCalories += foods[j]->foodCalories();
-			}
-			if (candTotalWeight <= total_weight)
-			{
-				if (candTotalCalories > bestTotalCalries)
-				{
-					// We will clear the best veector to get ready to update the best.
-					BestFoodVector->clear();
-					bestTotalCalries = candTotalCalories;
-					// Adding the elements from the candidate to the best vector.
-					for (auto& food : *CandidateFoodVector)
-					{
-						BestFoodVector->push_back(food);
-					}
-				}
-			}
-		}
-	}
+);
+
+// Index of the lowest set bit of x, which must be nonzero.
+int lowest_set_bit(uint64_t x);
 
-	// Return the vector with the items that satisfy the algorithm
-	return BestFoodVector;
+// Return the positions of the set bits of mask, in ascending order.
+void food_indices_from_mask(uint64_t mask, FoodIndexVector& result);
+
+// Same as above, into a new vector.
+std::unique_ptr<FoodIndexVector> food_indices_from_mask(uint64_t mask);
+
+// A time past which the exact solvers that take one give up, without a
+// result, rather than run on. NO_SOLVER_DEADLINE never passes, and checking
+// it does not read the clock.
+typedef std::chrono::steady_clock::time_point SolverDeadline;
+const SolverDeadline NO_SOLVER_DEADLINE = SolverDeadline::max();
+
+//
+inline bool solver_deadline_passed(SolverDeadline deadline)
+{
+	return deadline != NO_SOLVER_DEADLINE && std::chrono::steady_clock::now() >= deadline;
 }
 
-// Compute the optimal set of food items with dynamic programming.
-// Specifically, among the food items that fit within a total_weight,
-// choose the foods whose calories-per-weight is greatest.
-// Repeat until no more food items can be chosen, either because we've
-// run out of food items, or run out of space.
-std::unique_ptr<FoodVector> dynamic_max_calories
+// Number of subsets the Gray-code walks visit between deadline checks.
+const uint64_t GRAY_STEPS_PER_DEADLINE_CHECK = uint64_t(1) << 16;
+
+// Same search as exhaustive_max_calories, visiting the subsets in Gray-code
+// order. Consecutive Gray codes differ in exactly one item (the lowest set
+// bit of the step number), so the running weight and calories are updated
+// with one addition or subtraction per subset instead of being re-summed,
+// and the best subset is kept as a mask. That makes the search O(2^n) with
+// no allocation until the mask is turned into indices at the end.
+// Weights that are whole ounces (or any values exactly representable in a
+// double, summed below 2^53) add and subtract exactly, so the feasibility
+// test sees the same totals as a fresh sum would.
+// The deadline is checked before the walk and every
+// GRAY_STEPS_PER_DEADLINE_CHECK subsets; once it has passed, best is left
+// empty and false is returned.
+// n must be less than 64. Writes positions in the catalog to best, in
+// ascending order.
+bool exhaustive_max_calories_gray
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	FoodIndexVector& best,
+	SolverDeadline deadline = NO_SOLVER_DEADLINE
+);
+
+// Same as above, into a new vector.
+std::unique_ptr<FoodIndexVector> exhaustive_max_calories_gray
+(
+	const FoodCatalog& foods,
+	double total_weight
+);
+
+// FoodVector adapter for exhaustive_max_calories_gray.
+std::unique_ptr<FoodVector> exhaustive_max_calories_gray
 (
 	const FoodVector& foods,
 	double total_weight
-)
-{
-	// Declare the vectors we will need to help achieve our algorithim.
-	// Temp will be the row of the matrix, T is our 2D Vector, and best is
-	// our traceback vector that has the best items.
-	std::vector<double> Temp;
-  std::vector<std::vector<double>> T;
-	std::unique_ptr<FoodVector> best(new FoodVector);
-
-	// This first for loop will initialize the first row as all zeros and add this
-	// vector to our 2D vector.
-	for (int init = 0; init <= total_weight; init++)
-	{
-		Temp.push_back(0);
-	}
-	T.push_back(Temp);
-	Temp.clear();
+);
 
-	// This is the for loop for creating our DP table.
-	for (int i = 0; i < int(foods.size()); i++)
-  {
-    for (int j = 0; j <= total_weight; j++)
-    {
-			// Check if the items weight fits in the column
-			if (foods[i]->weight() <= j)
-			{
-				// Compute the algorithm for deciding which value to use.
-				Temp.push_back(std::max(((foods[i]->foodCalories()) + (T[i][j - foods[i]->weight()])), T[i][j]));
-			}
+// Largest chunk of Gray-code steps in exhaustive_max_calories_parallel, as a
+// power of two.
+const int GRAY_PARALLEL_MAX_CHUNK_BITS = 16;
 
-			// If it doesn't fit, we will bring the value of the item from above.
-			else
-			{
-				Temp.push_back(T[i][j]);
-			}
-    }
-		// Push the vector to the DP Table and clear it for the next run.
-		T.push_back(Temp);
-		Temp.clear();
-  }
+// Same search as exhaustive_max_calories_gray, spread over the threads of
+// pool.
+// The 2^n Gray-code steps are cut into chunks of 2^min(n - 12, 16) steps
+// (one chunk for n up to 12), which the threads claim one at a time from a
+// shared counter. A chunk starts by summing its first subset from scratch
+// and then walks the rest incrementally. Each thread keeps its own best
+// subset, and the bests are reduced at the end; ties go to the subset the
+// sequential walk would have reached first. The chunks do not depend on the
+// thread count, and so neither do the sums or the answer. With weights and
+// calories that add exactly (whole numbers, say) the answer is also that of
+// exhaustive_max_calories_gray; otherwise the two walks round differently,
+// and may differ at the capacity boundary or between near-ties.
+// n must be less than 64. Returns positions in the catalog, in ascending
+// order.
+std::unique_ptr<FoodIndexVector> exhaustive_max_calories_parallel
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	ThreadPool& pool
+);
 
-	// The step is going to be the weight and what we will use to tell us how far
-	// to the left we move. The loop will keep going till we reach the wall.
-	int step = total_weight;
-	for (int i = foods.size(); i > 0; i--)
-	{
-		// Checks if the value is equal to the one above.
-		if (T[i][step] != T[i-1][step])
-		{
-			// If it is not equal, that means that we add the item to our best vector
-			// and modify the step to tell us how far to the left we move.
-			best->push_back(foods[i-1]);
-			step -= foods[i-1]->weight();
-		}
-	}
+// Same as above, on a pool of thread_count threads (0 means one per
+// hardware thread) started for the call.
+std::unique_ptr<FoodIndexVector> exhaustive_max_calories_parallel
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	unsigned thread_count = 0
+);
 
-	// Return the vector with the items that satisfy the algorithm
-	return best;
-}
+// FoodVector adapter for exhaustive_max_calories_parallel.
+std::unique_ptr<FoodVector> exhaustive_max_calories_parallel
+(
+	const FoodVector& foods,
+	double total_weight,
+	unsigned thread_count = 0
+);
+
+// Compute the optimal set of food items exactly by meet in the middle.
+// The items are split into a low and a high half. Every subset of the high
+// half is listed with its weight and calories, sorted by weight, and given a
+// running maximum of calories, so "the best high subset weighing at most x"
+// is one binary search. Every subset of the low half is then visited in
+// Gray-code order and paired with the best high subset that fits in the
+// remaining weight.
+// This takes O(2^(n/2) * n) time and O(2^(n/2)) memory, which makes it
+// practical for roughly 25 to 45 items, and unlike the DP solvers it does
+// not round fractional weights.
+// The deadline is checked before each half is listed and every
+// GRAY_STEPS_PER_DEADLINE_CHECK subsets of it; once it has passed, nullptr
+// is returned.
+// n must be less than 64. Returns positions in the catalog, in ascending
+// order.
+std::unique_ptr<FoodIndexVector> mitm_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverDeadline deadline = NO_SOLVER_DEADLINE
+);
+
+// FoodVector adapter for mitm_max_calories.
+std::unique_ptr<FoodVector> mitm_max_calories
+(
+	const FoodVector& foods,
+	double total_weight
+);
+
+// Optional budget for branch_bound_max_calories, which stops with the best
+// solution found so far once either limit is reached. Zero means no limit.
+struct BranchBoundLimits
+{
+	uint64_t max_nodes = 0;
+	double max_seconds = 0;
+};
+
+// What a branch_bound_max_calories search did. optimal is true when the
+// search finished within its limits, so the answer is proven optimal.
+struct BranchBoundStats
+{
+	uint64_t nodes = 0;
+	uint64_t pruned = 0;
+	bool optimal = false;
+};
+
+// Depth-first branch-and-bound search state for branch_bound_max_calories.
+// Items are the candidates sorted by calories per ounce, best first, so the
+// fractional (greedy) relaxation of any suffix with a capacity is a prefix
+// of that suffix plus a fraction of the next item, which the prefix sums
+// answer with one binary search.
+class BranchBoundSearch
+{
+	//
+	public:
+
+		//
+		BranchBoundSearch
+		(
+			const FoodCatalog& foods,
+			const FoodIndexVector& order,
+			const BranchBoundLimits& limits
+		)
+			:
+			_foods(foods),
+			_order(order),
+			_limits(limits),
+			_start(std::chrono::steady_clock::now())
+		{
+			const size_t m = order.size();
+			_prefix_weight.resize(m + 1, 0);
+			_prefix_calories.resize(m + 1, 0);
+			for (size_t k = 0; k < m; k++)
+			{
+				_prefix_weight[k + 1] = _prefix_weight[k] + foods.weight(order[k]);
+				_prefix_calories[k + 1] = _prefix_calories[k] + foods.foodCalories(order[k]);
+			}
+		}
+
+		// Run the search from the root, with the given capacity.
+		void run(double capacity)
+		{
+			search(0, capacity, 0);
+			_stats.optimal = !_stopped;
+		}
+
+		//
+		const FoodIndexVector& best() const { return _best; }
+		const BranchBoundStats& stats() const { return _stats; }
+
+	//
+	private:
+
+		// Upper bound on the calories that items k.. can add within capacity.
+		double fractional_bound(size_t k, double capacity) const
+		{
+			const size_t m = _order.size();
+			const double limit = _prefix_weight[k] + capacity;
+			size_t last = std::upper_bound(_prefix_weight.begin() + k, _prefix_weight.end(), limit) - _prefix_weight.begin() - 1;
+
+			double bound = _prefix_calories[last] - _prefix_calories[k];
+			if (last < m)
+			{
+				const size_t i = _order[last];
+				bound += (limit - _prefix_weight[last]) * _foods.foodCalories(i) / _foods.weight(i);
+			}
+
+			// Leave room for rounding in the prefix sums, so that rounding can
+			// only cost pruning, never the optimum.
+			return bound * (1 + 1e-12) + 1e-9;
+		}
+
+		// True once a node or time limit has been hit.
+		bool out_of_budget()
+		{
+			if (_stopped)
+			{
+				return true;
+			}
+			if (_limits.max_nodes != 0 && _stats.nodes >= _limits.max_nodes)
+			{
+				_stopped = true;
+			}
+			else if (_limits.max_seconds > 0 && _stats.nodes % 1024 == 0)
+			{
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+				_stopped = elapsed.count() >= _limits.max_seconds;
+			}
+			return _stopped;
+		}
+
+		// Decide item k onward, with capacity left and calories already taken.
+		// Skipping item k is the next iteration of the loop rather than a
+		// recursive call, so the recursion is only as deep as the number of
+		// items taken, not the number of candidates.
+		void search(size_t k, double capacity, double calories)
+		{
+			for (; ; k++)
+			{
+				if (out_of_budget())
+				{
+					return;
+				}
+				_stats.nodes++;
+
+				if (calories > _best_calories)
+				{
+					_best_calories = calories;
+					_best = _taken;
+				}
+
+				if (k == _order.size())
+				{
+					return;
+				}
+
+				if (calories + fractional_bound(k, capacity) <= _best_calories)
+				{
+					_stats.pruned++;
+					return;
+				}
+
+				const size_t i = _order[k];
+				if (_foods.weight(i) <= capacity)
+				{
+					_taken.push_back(i);
+					search(k + 1, capacity - _foods.weight(i), calories + _foods.foodCalories(i));
+					_taken.pop_back();
+				}
+			}
+		}
+
+		const FoodCatalog& _foods;
+		const FoodIndexVector& _order;
+		const BranchBoundLimits _limits;
+		const std::chrono::steady_clock::time_point _start;
+
+		// _prefix_weight[k] is the weight of _order[0, k), and so on.
+		std::vector<double> _prefix_weight;
+		std::vector<double> _prefix_calories;
+
+		// Items taken on the current path, and the best set found so far.
+		FoodIndexVector _taken;
+		FoodIndexVector _best;
+		double _best_calories = 0;
+
+		BranchBoundStats _stats;
+		bool _stopped = false;
+};
+
+// Compute the optimal set of food items by branch and bound.
+// Items are sorted by calories per ounce and searched depth first, taking
+// each item before leaving it out, so the first leaf reached is the greedy
+// solution. A subtree is pruned when its greedy fractional relaxation cannot
+// beat the best solution so far. When calorie density is skewed, as in
+// food.csv, most of the tree is pruned and even thousand-item instances
+// finish far faster than the W-wide DP.
+// With limits, this is an anytime solver: it returns the best solution found
+// before running out of nodes or time. If stats is given it receives the
+// node counts and whether the answer is proven optimal.
+// Weights are used exactly. Returns positions in the catalog, in ascending
+// order.
+std::unique_ptr<FoodIndexVector> branch_bound_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	const BranchBoundLimits& limits = BranchBoundLimits(),
+	BranchBoundStats* stats = nullptr
+);
+
+// FoodVector adapter for branch_bound_max_calories.
+std::unique_ptr<FoodVector> branch_bound_max_calories
+(
+	const FoodVector& foods,
+	double total_weight,
+	const BranchBoundLimits& limits = BranchBoundLimits(),
+	BranchBoundStats* stats = nullptr
+);
+
+// Compute a good set of food items quickly by the greedy density rule, for
+// requests that cannot wait for an exact solver.
+// Items are taken in decreasing calories per ounce until the next one does
+// not fit (the "critical" item); the remaining capacity is then filled with
+// any later item that still fits. The items are only sorted as far as
+// needed: the densest block is found with partial_sort, doubling the block
+// until the critical item turns up. If the single most caloric item that
+// fits beats the greedy set, it is returned instead, which guarantees at
+// least half the optimal calories.
+// If upper_bound is given it receives the fractional relaxation bound. No
+// solution can beat it, so upper_bound minus the returned calories is the
+// worst-case gap to the optimum.
+// Weights are used exactly. Writes positions in the catalog to best, in
+// ascending order.
+void greedy_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& best_indices,
+	double* upper_bound = nullptr
+);
+
+// Same as above, allocating its own scratch and result.
+std::unique_ptr<FoodIndexVector> greedy_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double* upper_bound = nullptr
+);
+
+// FoodVector adapter for greedy_max_calories.
+std::unique_ptr<FoodVector> greedy_max_calories
+(
+	const FoodVector& foods,
+	double total_weight,
+	double* upper_bound = nullptr
+);
+
+// DP row kernels.
+// Every DP solver spends its time in the same 0/1 knapsack row update: for
+// each column j in [lo, hi),
+//
+//	cur[j] = max(prev[j], prev[j - w] + c)	when w <= j
+//	cur[j] = prev[j]	otherwise
+//
+// and, when take is not null, bit j of take is set for each column where the
+// item strictly improved the value. The columns are processed from high to
+// low, so cur may be the same row as prev and the update happens in place
+// (only columns below j are read, and each block is read before it is
+// written). Rows are contiguous, so the update vectorizes: on x86 an AVX2
+// version is picked at run time when the CPU supports it, and the portable
+// scalar version is used otherwise. There is a double version and integer
+// versions, for calories stored as fixed-point uint32_t or uint64_t (see
+// dynamic_max_calories_fixed); integer sums must not overflow, and uint64_t
+// values must stay below 2^63.
+
+// Set the take bits for count consecutive columns starting at first.
+void dp_set_take_bits(uint64_t* take, size_t first, uint64_t bits, unsigned count);
+
+// Portable row update; see "DP row kernels" above.
+template <typename Value>
+void dp_row_update_scalar
+(
+	const Value* prev,
+	Value* cur,
+	size_t lo,
+	size_t hi,
+	size_t w,
+	Value c,
+	uint64_t* take
+)
+{
+	const size_t start = std::min(hi, std::max(lo, w));
+	if (cur != prev)
+	{
+		std::copy(prev + lo, prev + start, cur + lo);
+	}
+
+	for (size_t j = hi; j-- > start; )
+	{
+		const Value candidate = prev[j - w] + c;
+		if (candidate > prev[j])
+		{
+			cur[j] = candidate;
+			if (take)
+			{
+				take[j / 64] |= uint64_t(1) << (j % 64);
+			}
+		}
+		else if (cur != prev)
+		{
+			cur[j] = prev[j];
+		}
+	}
+}
+
+#ifdef MAXCALORIE_AVX2_KERNELS
+
+// AVX2 row update for doubles, four columns at a time.
+__attribute__((target("avx2")))
+void dp_row_update_avx2
+(
+	const double* prev,
+	double* cur,
+	size_t lo,
+	size_t hi,
+	size_t w,
+	double c,
+	uint64_t* take
+);
+
+// AVX2 row update for uint32_t calories, eight columns at a time.
+__attribute__((target("avx2")))
+void dp_row_update_avx2
+(
+	const uint32_t* prev,
+	uint32_t* cur,
+	size_t lo,
+	size_t hi,
+	size_t w,
+	uint32_t c,
+	uint64_t* take
+);
+
+// AVX2 row update for uint64_t calories, four columns at a time.
+__attribute__((target("avx2")))
+void dp_row_update_avx2
+(
+	const uint64_t* prev,
+	uint64_t* cur,
+	size_t lo,
+	size_t hi,
+	size_t w,
+	uint64_t c,
+	uint64_t* take
+);
+
+#endif
+
+// True when the vectorized row kernels can be used on this CPU. Checked once.
+bool dp_row_kernel_vectorized();
+
+// Row update with run-time CPU dispatch; see "DP row kernels" above.
+template <typename Value>
+void dp_row_update
+(
+	const Value* prev,
+	Value* cur,
+	size_t lo,
+	size_t hi,
+	size_t w,
+	Value c,
+	uint64_t* take = nullptr
+)
+{
+	MAXCALORIE_STATS_ADD(dp_cells, hi - lo);
+#ifdef MAXCALORIE_AVX2_KERNELS
+	if (dp_row_kernel_vectorized())
+	{
+		dp_row_update_avx2(prev, cur, lo, hi, w, c, take);
+		return;
+	}
+#endif
+	dp_row_update_scalar(prev, cur, lo, hi, w, c, take);
+}
+
+// Weights are quantized for the DP solvers in units of weight_resolution
+// ounces (1 means whole ounces, 0.1 tenths of an ounce, 0.035274 grams).
+// Item weights are rounded up and the capacity is rounded down, so a DP
+// solution always fits in the real capacity; a finer resolution loses less
+// to rounding but makes every DP row proportionally wider. The small slack
+// keeps weights that are whole multiples of the resolution, like 0.3 at 0.1,
+// from being bumped up a unit by floating point error.
+const double DP_QUANTIZATION_SLACK = 1e-9;
+
+// An item weight in DP units; see DP_QUANTIZATION_SLACK. Every item is at
+// least one unit.
+size_t dp_weight_unit(double weight_ounces, double weight_resolution);
+
+// All the item weights of a catalog in DP units.
+void dp_weight_units(const FoodCatalog& catalog, double weight_resolution, std::vector<size_t>& units);
+
+// Same as above, into a new vector.
+std::vector<size_t> dp_weight_units(const FoodCatalog& catalog, double weight_resolution);
+
+// The capacity total_weight in DP units, rounded down; total_weight must not
+// be negative.
+size_t dp_capacity_units(double total_weight, double weight_resolution);
+
+// What a DP over item_count items up to total_weight would cost at a given
+// weight resolution, so callers can pick a resolution, or a solver, before
+// committing the memory.
+struct DynamicCost
+{
+	// The capacity in DP units; every row has capacity_units + 1 columns.
+	size_t capacity_units = 0;
+
+	// Item x column cells each DP solver evaluates (linear memory evaluates
+	// about twice this).
+	uint64_t cells = 0;
+
+	// Peak bytes of DP state for dynamic_max_calories (the full table),
+	// dynamic_max_calories_rolling (one row plus the take bitset) and
+	// dynamic_max_calories_linear_memory (a few rows).
+	uint64_t table_bytes = 0;
+	uint64_t rolling_bytes = 0;
+	uint64_t linear_memory_bytes = 0;
+};
+
+//
+DynamicCost estimate_dynamic_cost
+(
+	size_t item_count,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+// Same traceback as dynamic_max_calories, reading the packed take bitset
+// (words_per_row 64-bit words per item) instead of comparing adjacent rows
+// of a table. Appends the items of an optimal set for the given capacity to
+// best, in descending order. Also works on take bits filled over whole rows,
+// as long as the weights are the ones the bits were filled with.
+void dp_take_traceback
+(
+	const std::vector<uint64_t>& take,
+	size_t words_per_row,
+	const std::vector<size_t>& weights,
+	size_t capacity,
+	FoodIndexVector& best
+);
+
+// Compute the optimal set of food items with dynamic programming.
+// Specifically, among the food items that fit within a total_weight,
+// choose the foods whose calories-per-weight is greatest.
+// Repeat until no more food items can be chosen, either because we've
+// run out of food items, or run out of space.
+// Weights are quantized in units of weight_resolution ounces, rounding item
+// weights up and total_weight down (see DP_QUANTIZATION_SLACK), so the
+// result always fits. Writes positions in the catalog to best, in
+// descending (traceback) order.
+// If all the items fit, the DP is skipped and every item with positive
+// calories is taken. Otherwise row i is only computed up to the smaller
+// of the capacity and the total weight of items 0..i, past which it is
+// flat, so a few items against a large capacity cost far less than n x W.
+void dynamic_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& best_indices,
+	double weight_resolution = 1
+);
+
+// Same as above, allocating its own scratch and result.
+std::unique_ptr<FoodIndexVector> dynamic_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+// FoodVector adapter for dynamic_max_calories.
+std::unique_ptr<FoodVector> dynamic_max_calories
+(
+	const FoodVector& foods,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+// The forward pass of dynamic_max_calories_rolling: run the DP over all the
+// items up to capacity with one rolling row, and record the take bits. On
+// return row holds the final DP row and take the n x (capacity + 1) bitset,
+// each row padded to a whole number of 64-bit words; returns the number of
+// words per row. Both vectors are resized as needed, keeping their storage.
+// Like dynamic_max_calories, each item's update stops at the prefix weight;
+// the take bits past it are left unset, and dp_take_traceback accounts for
+// that. The deadline is checked before each item; once it has passed, 0 is
+// returned and row and take are incomplete.
+size_t dp_fill_take_bitset
+(
+	const std::vector<size_t>& weights,
+	const double* calories,
+	size_t capacity,
+	std::vector<uint64_t>& take,
+	std::vector<double>& row,
+	SolverDeadline deadline = NO_SOLVER_DEADLINE
+);
+
+// Compute the same optimal set of food items as dynamic_max_calories, in the
+// same traceback order, without materializing the (n+1) x (W+1) table of
+// doubles.
+// Only one row of calorie totals is kept. It is updated in place from the
+// largest capacity down, so each cell still reads the previous item's values.
+// Whether item i improved column j is recorded in a packed n x (W+1) "take"
+// bitset, which is all the traceback needs. That is 1 bit per cell instead of
+// 8 bytes.
+// Weights are quantized as in dynamic_max_calories. Returns false, with best
+// empty, if the deadline passed before the last item (see
+// dp_fill_take_bitset).
+bool dynamic_max_calories_rolling
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& best,
+	double weight_resolution = 1,
+	SolverDeadline deadline = NO_SOLVER_DEADLINE
+);
+
+// Same as above, allocating its own scratch and result.
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_rolling
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+// FoodVector adapter for dynamic_max_calories_rolling.
+std::unique_ptr<FoodVector> dynamic_max_calories_rolling
+(
+	const FoodVector& foods,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+// Calories per unit for dynamic_max_calories_fixed: hundredths, the
+// precision of food.csv.
+const double DP_DEFAULT_CALORIE_SCALE = 100;
+
+// Calories as fixed-point integers for dynamic_max_calories_fixed: each
+// value times scale, rounded to the nearest integer, with anything not
+// positive as 0 (such items are never worth taking). Returns the sum of the
+// scaled values, which bounds every DP cell.
+uint64_t dp_fixed_point_calories(const FoodCatalog& catalog, double scale, std::vector<uint64_t>& values);
+
+// Same optimal set as dynamic_max_calories_rolling, with calories in fixed
+// point instead of doubles.
+// Calories are scaled by calorie_scale and rounded to integers, which is
+// exact for calories with at most two decimals at the default scale. The DP
+// row then holds the narrowest type that fits the total of all the scaled
+// calories: uint32_t when it is below 2^32, which halves the memory traffic
+// of the row update and doubles its vector width, and uint64_t otherwise.
+// Integer sums have no rounding error, so ties are real ties and the take
+// bits, and the traceback, are exact. Weights are quantized as in
+// dynamic_max_calories; positions are written in descending order.
+void dynamic_max_calories_fixed
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	SolverWorkspace& workspace,
+	FoodIndexVector& best,
+	double weight_resolution = 1,
+	double calorie_scale = DP_DEFAULT_CALORIE_SCALE
+);
+
+// Same as above, allocating its own scratch and result.
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_fixed
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution = 1,
+	double calorie_scale = DP_DEFAULT_CALORIE_SCALE
+);
+
+// Answer many capacities against the same items with one DP pass.
+// The rolling DP with its take bitset is built once, up to the largest
+// capacity. A column of the bitset holds the decisions for that capacity
+// and every smaller one (each DP cell is the best total within at most that
+// capacity), so each query is then only an O(n) traceback from its own
+// column. Result k is exactly what dynamic_max_calories_rolling would return
+// for capacities[k]; negative capacities get empty results.
+// The results vector is resized to capacities.size(), reusing the storage
+// of the vectors already in it.
+void dynamic_max_calories_batch
+(
+	const FoodCatalog& foods,
+	const std::vector<double>& capacities,
+	SolverWorkspace& workspace,
+	std::vector<FoodIndexVector>& results,
+	double weight_resolution = 1
+);
+
+// Same as above, allocating its own scratch and results.
+std::vector<std::unique_ptr<FoodIndexVector>> dynamic_max_calories_batch
+(
+	const FoodCatalog& foods,
+	const std::vector<double>& capacities,
+	double weight_resolution = 1
+);
+
+// FoodVector adapter for dynamic_max_calories_batch.
+std::vector<std::unique_ptr<FoodVector>> dynamic_max_calories_batch
+(
+	const FoodVector& foods,
+	const std::vector<double>& capacities,
+	double weight_resolution = 1
+);
+
+// Bytes of the file the streaming solver reads at a time.
+const size_t FOOD_STREAM_CHUNK_BYTES = 1 << 20;
+
+// Solve a food database file without loading it.
+// The result is the same as loading the file with load_food_catalog,
+// filtering it with filter_food_catalog(min_calories, max_calories,
+// total_size) and solving with dynamic_max_calories_rolling, but the catalog
+// is never built: a parser thread reads the file chunk_bytes at a time and
+// passes the weights and calories of the items that pass the filter, a
+// chunk at a time through a short BoundedQueue, to the calling thread, which
+// runs them through the rolling DP as they arrive. Besides the DP row and
+// take bitset, only each kept item's weight in DP units and the file offset
+// of its line are stored; the chosen lines are read again at the end.
+// Reading stops once total_size items are kept, so a malformed line after
+// that point is not noticed.
+// Returns the chosen items in traceback (descending file) order, an empty
+// catalog for a negative total_weight, and nullptr on the errors of
+// load_food_catalog or an invalid total_size.
+std::unique_ptr<FoodCatalog> streaming_max_calories
+(
+	const std::string& path,
+	double min_calories,
+	double max_calories,
+	int total_size,
+	double total_weight,
+	double weight_resolution = 1,
+	size_t chunk_bytes = FOOD_STREAM_CHUNK_BYTES
+);
+
+// Two-constraint solvers.
+// These limit a second resource besides the weight: with second =
+// foods.volumes() the truck's volume, with second = foods.costs() the
+// budget, or any other non-negative amount per item (second[i] for item i).
+// The optimum is the set of items with the most calories whose weights sum
+// to at most total_weight and whose second amounts sum to at most
+// second_limit. Results are positions in the catalog, in descending order;
+// a negative limit gives an empty result.
+
+// Largest memory, in bytes, for which max_calories_2d uses the exact DP:
+// the take bitset plus the plane of doubles, which does not shrink with n.
+// Past it, the Lagrangian heuristic.
+const uint64_t DP_2D_MAX_BYTES = uint64_t(256) << 20;
+
+// Exact two-constraint DP.
+// The table is one flat (W + 1) x (S + 1) plane of doubles, W and S being
+// the two limits in DP units, updated in place for each item from the
+// largest capacities down, as in dynamic_max_calories_rolling; which items
+// improved which cells goes in a packed n x (W + 1) x (S + 1) take bitset,
+// which is the memory that counts. Both dimensions are quantized like the
+// weight is in dynamic_max_calories, except that a second amount may be 0.
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_2d
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	const double* second,
+	double second_limit,
+	double weight_resolution = 1,
+	double second_resolution = 1
+);
+
+// Heuristic two-constraint solver by Lagrangian relaxation, for a second
+// dimension too fine for the exact DP.
+// The second constraint is priced into the calories: for a multiplier
+// lambda >= 0 the weight-only rolling DP is solved on calories[i] - lambda *
+// second[i], and lambda is bisected between 0 and the largest calories per
+// unit of second to find the cheapest price at which the chosen set fits the
+// second limit. The best set that fits, from any lambda, is then filled
+// greedily by density with the items left over. Only the weight is
+// quantized; the second amounts are used exactly.
+// If upper_bound is given it receives the smallest Lagrangian bound found
+// (the relaxed optimum plus lambda times second_limit), which no solution
+// can beat.
+std::unique_ptr<FoodIndexVector> lagrangian_max_calories_2d
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	const double* second,
+	double second_limit,
+	double weight_resolution = 1,
+	double* upper_bound = nullptr
+);
+
+// dynamic_max_calories_2d when its plane and take bitset fit in
+// DP_2D_MAX_BYTES, lagrangian_max_calories_2d otherwise.
+std::unique_ptr<FoodIndexVector> max_calories_2d
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	const double* second,
+	double second_limit,
+	double weight_resolution = 1,
+	double second_resolution = 1
+);
+
+// One chosen item of a bounded solution: a catalog position and how many of
+// its units to take.
+struct FoodQuantity
+{
+	size_t index;
+	uint32_t count;
+
+	bool operator==(const FoodQuantity& other) const
+	{
+		return index == other.index && count == other.count;
+	}
+};
+
+// Alias for a bounded solution, in ascending position order.
+typedef std::vector<FoodQuantity> FoodQuantityVector;
+
+// Compute the optimal selection when every item may be taken up to its
+// quantity() times: the bounded knapsack.
+// Each item is split into pseudo-items of 1, 2, 4, ... units plus a
+// remainder, so any count up to the quantity is a sum of distinct pieces and
+// an item of quantity q costs about log2(q) DP rows instead of q. Counts are
+// first capped at how many units fit in total_weight at all. The pieces are
+// solved with the rolling 0/1 DP and its take bitset, and the chosen pieces
+// are summed back per item.
+// Weights are quantized as in dynamic_max_calories, per unit.
+std::unique_ptr<FoodQuantityVector> bounded_max_calories
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+// FoodVector adapter for bounded_max_calories. Each chosen item appears in
+// the result once per unit taken, so sum_food_vector gives the totals.
+std::unique_ptr<FoodVector> bounded_max_calories
+(
+	const FoodVector& foods,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+// A DP solver that keeps its state between calls, for an item set that
+// changes a few items at a time.
+// Items are added and removed by caller-chosen ids (catalog positions, say).
+// The solver keeps the current DP row, the take bitset of every item, and a
+// checkpoint copy of the row after every CHECKPOINT_INTERVAL items.
+// Adding an item is one row update. Removing one rebuilds only the rows
+// from the last checkpoint before it, so removing recently added stock is
+// cheap and removing the oldest item costs a full rebuild. Memory is the
+// bitset plus one extra row per CHECKPOINT_INTERVAL items, about 2 bits per
+// cell in all. solve() is an O(n) traceback, like dynamic_max_calories_batch,
+// for any capacity up to the one the solver was created with.
+class IncrementalDynamicSolver
+{
+	//
+	public:
+
+		// Items added between row checkpoints.
+		static const size_t CHECKPOINT_INTERVAL = 64;
+
+		// Create a solver with no items, for capacities up to max_weight ounces,
+		// with weights quantized as in dynamic_max_calories.
+		IncrementalDynamicSolver
+		(
+			double max_weight,
+			double weight_resolution = 1
+		)
+			:
+			_weight_resolution(weight_resolution),
+			_capacity(dp_capacity_units(std::max(max_weight, 0.0), weight_resolution)),
+			_words_per_row(_capacity / 64 + 1),
+			_row(_capacity + 1, 0),
+			_checkpoints(_row)
+		{
+		}
+
+		//
+		size_t size() const { return _ids.size(); }
+		const FoodIndexVector& ids() const { return _ids; }
+
+		// Add one item; costs one DP row update.
+		void add_item(size_t id, double weight_ounces, double calories)
+		{
+			assert(weight_ounces > 0);
+			_ids.push_back(id);
+			_units.push_back(dp_weight_unit(weight_ounces, _weight_resolution));
+			_calories.push_back(calories);
+			update_row(_ids.size() - 1);
+		}
+
+		// Add every item of a catalog, with its position as the id.
+		void add_catalog(const FoodCatalog& foods)
+		{
+			for (size_t i = 0; i < foods.size(); i++)
+			{
+				add_item(i, foods.weight(i), foods.foodCalories(i));
+			}
+		}
+
+		// Remove the item with the given id (the most recently added one, if
+		// the id was used more than once), rebuilding the DP rows from the
+		// last checkpoint before it. Returns false if there is no such item.
+		bool remove_item(size_t id)
+		{
+			size_t position = _ids.size();
+			while (position > 0 && _ids[position - 1] != id)
+			{
+				position--;
+			}
+			if (position == 0)
+			{
+				return false;
+			}
+			position--;
+
+			_ids.erase(_ids.begin() + position);
+			_units.erase(_units.begin() + position);
+			_calories.erase(_calories.begin() + position);
+
+			const size_t checkpoint = position / CHECKPOINT_INTERVAL;
+			const size_t width = _capacity + 1;
+			_checkpoints.resize((checkpoint + 1) * width);
+			std::copy(_checkpoints.end() - width, _checkpoints.end(), _row.begin());
+			_take.resize(checkpoint * CHECKPOINT_INTERVAL * _words_per_row);
+
+			for (size_t i = checkpoint * CHECKPOINT_INTERVAL; i < _ids.size(); i++)
+			{
+				update_row(i);
+			}
+			return true;
+		}
+
+		// Best total calories of the current items within total_weight.
+		double best_calories(double total_weight) const
+		{
+			if (total_weight < 0)
+			{
+				return 0;
+			}
+			return _row[capacity_units(total_weight)];
+		}
+
+		// An optimal set of the current items within total_weight (clamped to
+		// the solver's max_weight), as ids, most recently added first.
+		std::unique_ptr<FoodIndexVector> solve(double total_weight) const
+		{
+			std::unique_ptr<FoodIndexVector> best(new FoodIndexVector);
+			if (total_weight >= 0)
+			{
+				dp_take_traceback(_take, _words_per_row, _units, capacity_units(total_weight), *best);
+				remap_food_indices(_ids, *best);
+			}
+			return best;
+		}
+
+	//
+	private:
+
+		// total_weight in DP units, clamped to the solver's capacity.
+		size_t capacity_units(double total_weight) const
+		{
+			return std::min(_capacity, dp_capacity_units(total_weight, _weight_resolution));
+		}
+
+		// Apply item i, which must be the next one, to _row and its take bits,
+		// and save a checkpoint when one is due.
+		void update_row(size_t i)
+		{
+			_take.resize((i + 1) * _words_per_row, 0);
+			if (_units[i] <= _capacity)
+			{
+				dp_row_update(_row.data(), _row.data(), 0, _capacity + 1, _units[i], _calories[i], &_take[i * _words_per_row]);
+			}
+
+			if ((i + 1) % CHECKPOINT_INTERVAL == 0)
+			{
+				_checkpoints.resize(((i + 1) / CHECKPOINT_INTERVAL) * (_capacity + 1));
+				_checkpoints.insert(_checkpoints.end(), _row.begin(), _row.end());
+			}
+		}
+
+		const double _weight_resolution;
+		const size_t _capacity;
+		const size_t _words_per_row;
+
+		// The current items, in the order they were added.
+		FoodIndexVector _ids;
+		std::vector<size_t> _units;
+		std::vector<double> _calories;
+
+		// DP row after all the items, the take bits of each item, and
+		// checkpoint k: the row after the first k * CHECKPOINT_INTERVAL items.
+		std::vector<double> _row;
+		std::vector<uint64_t> _take;
+		std::vector<double> _checkpoints;
+};
+
+// Counters of a SolverCache.
+struct SolverCacheStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	size_t entries = 0;
+	size_t bytes = 0;
+};
+
+// A front end for the common "filter, then solve" request, with a
+// least-recently-used cache of the answers.
+// solve() filters the catalog like filter_food_catalog and solves the
+// filtered items like dynamic_max_calories_rolling. Answers are cached as
+// shared, immutable lists of catalog positions, keyed on the catalog's
+// content hash and size, the filter bounds, the capacity and the weight
+// resolution. The cache holds at most max_bytes of entries (index lists plus
+// a fixed overhead per entry), evicting the least recently used. It is safe
+// to share between threads; the solve itself runs outside the lock.
+class SolverCache
+{
+	//
+	public:
+
+		// Approximate bookkeeping bytes per entry, on top of its indices.
+		static const size_t ENTRY_OVERHEAD_BYTES = 128;
+
+		//
+		explicit SolverCache(size_t max_bytes = size_t(64) << 20)
+			:
+			_max_bytes(max_bytes)
+		{
+		}
+
+		// Positions in catalog of the optimal set of the food items chosen by
+		// filter_food_catalog(catalog, min_calories, max_calories, total_size)
+		// within total_weight, in dynamic_max_calories_rolling's order.
+		// Returns nullptr, uncached, for an invalid total_size.
+		std::shared_ptr<const FoodIndexVector> solve
+		(
+			const FoodCatalog& catalog,
+			double min_calories,
+			double max_calories,
+			int total_size,
+			double total_weight,
+			double weight_resolution = 1
+		)
+		{
+			const Key key{
+				catalog.content_hash(), catalog.size(),
+				min_calories, max_calories, total_size,
+				total_weight, weight_resolution
+			};
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				auto found = _index.find(key);
+				if (found != _index.end())
+				{
+					_stats.hits++;
+					_entries.splice(_entries.begin(), _entries, found->second);
+					return found->second->second;
+				}
+				_stats.misses++;
+			}
+
+			std::unique_ptr<FoodIndexVector> filtered = filter_food_catalog(catalog, min_calories, max_calories, total_size);
+			if (!filtered)
+			{
+				return nullptr;
+			}
+			std::unique_ptr<FoodIndexVector> best = dynamic_max_calories_rolling(catalog.subset(*filtered), total_weight, weight_resolution);
+			remap_food_indices(*filtered, *best);
+			std::shared_ptr<const FoodIndexVector> result(best.release());
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_index.find(key) == _index.end())
+			{
+				_entries.emplace_front(key, result);
+				_index[key] = _entries.begin();
+				_stats.entries++;
+				_stats.bytes += entry_bytes(*result);
+				evict();
+			}
+			return result;
+		}
+
+		// Current counters.
+		SolverCacheStats stats() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _stats;
+		}
+
+		// Drop every entry; the hit and miss counters are kept.
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_entries.clear();
+			_index.clear();
+			_stats.entries = 0;
+			_stats.bytes = 0;
+		}
+
+	//
+	private:
+
+		// Everything an answer depends on.
+		struct Key
+		{
+			uint64_t catalog_hash;
+			size_t catalog_size;
+			double min_calories, max_calories;
+			int total_size;
+			double total_weight, weight_resolution;
+
+			bool operator==(const Key& other) const
+			{
+				return catalog_hash == other.catalog_hash
+					&& catalog_size == other.catalog_size
+					&& min_calories == other.min_calories
+					&& max_calories == other.max_calories
+					&& total_size == other.total_size
+					&& total_weight == other.total_weight
+					&& weight_resolution == other.weight_resolution;
+			}
+		};
+
+		struct KeyHash
+		{
+			size_t operator()(const Key& key) const
+			{
+				uint64_t h = key.catalog_hash ^ (key.catalog_size * 0x9e3779b97f4a7c15ULL);
+				for (double value : {key.min_calories, key.max_calories, key.total_weight, key.weight_resolution, double(key.total_size)})
+				{
+					h = (h ^ std::hash<double>()(value)) * 0x100000001b3ULL;
+				}
+				return size_t(h);
+			}
+		};
+
+		typedef std::list<std::pair<Key, std::shared_ptr<const FoodIndexVector>>> EntryList;
+
+		static size_t entry_bytes(const FoodIndexVector& indices)
+		{
+			return ENTRY_OVERHEAD_BYTES + indices.size() * sizeof(size_t);
+		}
+
+		// Drop least recently used entries until the cache fits in _max_bytes.
+		// Called with _mutex held.
+		void evict()
+		{
+			while (_stats.bytes > _max_bytes && !_entries.empty())
+			{
+				auto& oldest = _entries.back();
+				_stats.bytes -= entry_bytes(*oldest.second);
+				_stats.entries--;
+				_stats.evictions++;
+				_index.erase(oldest.first);
+				_entries.pop_back();
+			}
+		}
+
+		const size_t _max_bytes;
+
+		// Most recently used first.
+		mutable std::mutex _mutex;
+		EntryList _entries;
+		std::unordered_map<Key, EntryList::iterator, KeyHash> _index;
+		SolverCacheStats _stats;
+};
+
+// Columns per block in dynamic_max_calories_parallel: 32 KiB of doubles, so
+// a block of both rows stays in L1/L2 while it is updated. A multiple of 64,
+// so no two threads ever write the same word of the take bitset.
+const size_t DP_PARALLEL_BLOCK_COLUMNS = 4096;
+
+// Compute the same optimal set of food items as dynamic_max_calories_rolling,
+// splitting every DP row across the threads of pool.
+// A row depends only on the row before it, so the columns are cut into
+// cache-sized blocks and each thread owns a contiguous run of blocks. Two
+// rows are kept (the previous one is read while the next one is written,
+// since other threads read across block edges), and the threads meet at a
+// barrier after each item. Take bits go into the same packed n x (W+1)
+// bitset as the rolling solver, so the traceback and the answer are
+// identical. This pays off once a row no longer fits in L2, at capacities of
+// around 10^5 units and up; smaller capacities use fewer threads, down to
+// the plain rolling solver.
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_parallel
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	ThreadPool& pool,
+	double weight_resolution = 1
+);
+
+// FoodVector adapter for dynamic_max_calories_parallel.
+std::unique_ptr<FoodVector> dynamic_max_calories_parallel
+(
+	const FoodVector& foods,
+	double total_weight,
+	ThreadPool& pool,
+	double weight_resolution = 1
+);
+
+// Fill row with the best total calories achievable from items [lo, hi) for
+// every capacity 0..capacity (row.size() - 1), using at most the given
+// capacity in each column. weights holds the item weights in DP units.
+void linear_memory_row
+(
+	const double* calories,
+	const std::vector<size_t>& weights,
+	size_t lo,
+	size_t hi,
+	std::vector<double>& row
+);
+
+// Append to best an optimal subset of items [lo, hi) within capacity, in
+// descending index order.
+// The range is split in half. A DP row for each half says how many calories
+// it can reach with every capacity, so the best way to divide capacity
+// between the halves is the k maximizing front[k] + back[capacity - k].
+// Both rows are released before recursing, so only O(capacity) values are
+// live at any time.
+void linear_memory_select
+(
+	const double* calories,
+	const std::vector<size_t>& weights,
+	size_t lo,
+	size_t hi,
+	size_t capacity,
+	FoodIndexVector& best
+);
+
+// Compute an optimal set of food items with dynamic programming, using only
+// O(W) memory for DP values, by Hirschberg-style divide and conquer over the
+// item range.
+// This costs roughly twice the arithmetic of dynamic_max_calories, but works
+// for capacities where an n x W table (or bitset) does not fit in memory.
+// The total calories match dynamic_max_calories; when several subsets tie,
+// a different one of them may be returned. Weights are quantized as in
+// dynamic_max_calories, and items are returned in descending index order.
+std::unique_ptr<FoodIndexVector> dynamic_max_calories_linear_memory
+(
+	const FoodCatalog& foods,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+// FoodVector adapter for dynamic_max_calories_linear_memory.
+std::unique_ptr<FoodVector> dynamic_max_calories_linear_memory
+(
+	const FoodVector& foods,
+	double total_weight,
+	double weight_resolution = 1
+);
+
+
+// Rough solver speeds, in seconds per unit of work, for choose_solver: per
+// subset of exhaustive_max_calories_gray, per n * 2^(n/2) step of
+// mitm_max_calories, per DP cell of dynamic_max_calories_rolling, and per
+// item of greedy_max_calories. Measured on an optimized build, and rounded
+// up.
+const double SOLVE_SECONDS_PER_SUBSET = 2e-9;
+const double SOLVE_SECONDS_PER_MITM_STEP = 6e-9;
+const double SOLVE_SECONDS_PER_DP_CELL = 1e-9;
+const double SOLVE_SECONDS_PER_GREEDY_ITEM = 2e-7;
+
+// Largest memory, in bytes, that choose_solver lets an exact solver
+// allocate: the take bitset of the DP, or the 24-byte entries for the
+// 2^ceil(n/2) subsets of mitm_max_calories' high half.
+const uint64_t SOLVE_MAX_EXACT_BYTES = uint64_t(1) << 30;
+
+// Longest estimated time, in seconds, that choose_solver gives an exact
+// solver even when there is no deadline.
+const double SOLVE_MAX_EXACT_SECONDS = 60;
+
+// Pick a solver for n items within total_weight, with seconds_left until
+// the deadline. Returns the name of the fastest exact solver that fits in
+// SOLVE_MAX_EXACT_BYTES and is expected to finish in time, and within
+// SOLVE_MAX_EXACT_SECONDS ("exhaustive", "mitm" or "dynamic"); failing that,
+// "branch_bound", to be run with the remaining time as its limit; and
+// "greedy" when there is not even time for that.
+const char* choose_solver
+(
+	size_t n,
+	double total_weight,
+	double weight_resolution,
+	double seconds_left
+);
+
+// One request to a SolveService: filter the catalog like filter_food_catalog
+// and solve within total_weight by the deadline. solver, if given, is run
+// instead of the one choose_solver would pick, and is named as choose_solver
+// names them ("exhaustive" and "mitm" need fewer than 64 items).
+struct SolveRequest
+{
+	std::shared_ptr<const FoodCatalog> catalog;
+	double min_calories = 0;
+	double max_calories = 0;
+	int total_size = 0;
+	double total_weight = 0;
+	double weight_resolution = 1;
+	SolverDeadline deadline = NO_SOLVER_DEADLINE;
+	const char* solver = nullptr;
+};
+
+// The answer to a SolveRequest. best holds positions in the request's
+// catalog, in ascending order, or is nullptr for an invalid total_size.
+// solver is the name of the solver that was run, or "greedy" if that answer
+// was better than the branch and bound one or the solver ran out of time.
+// optimal is true when the answer is
+// proven optimal (for "dynamic", with weights quantized to
+// weight_resolution).
+struct SolveResult
+{
+	std::unique_ptr<FoodIndexVector> best;
+	double weight = 0;
+	double calories = 0;
+	const char* solver = "";
+	bool optimal = false;
+};
+
+// Solve a request on the calling thread, as a SolveService job does.
+// The greedy answer is computed first, as the fallback; the solver picked
+// by choose_solver for the time left (after any time spent in the queue)
+// then replaces it, except that an interrupted branch and bound keeps
+// whichever of the two is better. Every solver is given the deadline: an
+// exact one that has not finished by then is dropped, leaving the greedy
+// answer, which is optimal only if it met its own bound. Uses the indices
+// and catalog members of the calling thread's thread_solver_workspace.
+SolveResult solve_request(const SolveRequest& request);
+
+// Runs solve_request for many callers at once on a WorkStealingPool.
+// submit() returns at once with a future of the result; the jobs of all
+// callers share the pool's threads, and each job uses that thread's
+// thread_solver_workspace. The catalog is held through its shared_ptr until
+// the job is done. A job that throws (std::bad_alloc, say) fails only its
+// own future, which rethrows from get(). Destroying the service waits for
+// the jobs already submitted.
+class SolveService
+{
+	//
+	public:
+
+		// Start a service on thread_count threads (0 means one per hardware
+		// thread), whose jobs call solve.
+		explicit SolveService
+		(
+			unsigned thread_count = 0,
+			std::function<SolveResult(const SolveRequest&)> solve = solve_request
+		)
+			:
+			_solve(std::move(solve)),
+			_pool(thread_count)
+		{
+		}
+
+		//
+		std::future<SolveResult> submit(const SolveRequest& request)
+		{
+			auto promise = std::make_shared<std::promise<SolveResult>>();
+			std::future<SolveResult> result = promise->get_future();
+			_pool.submit([this, request, promise]()
+			{
+				try
+				{
+					promise->set_value(_solve(request));
+				}
+				catch (...)
+				{
+					promise->set_exception(std::current_exception());
+				}
+			});
+			return result;
+		}
+
+		// Number of threads solving.
+		unsigned size() const { return _pool.size(); }
+
+	//
+	private:
+
+		// Declared before _pool, so it outlives the jobs the pool drains.
+		std::function<SolveResult(const SolveRequest&)> _solve;
+		WorkStealingPool _pool;
+};
@@ -0,0 +1,232 @@
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "benchmark.hh"
+#include "maxcalorie.hh"
+
+using namespace std;
+
+// Usage: maxcalorie_benchmark [--quick] [--cpu N | --no-pin] [--csv PATH]
+//   [--json PATH] [--label TEXT] [--compare BASELINE.csv] [--tolerance T]
+//
+// Sweeps every solver over n, capacity and catalog distribution (food.csv
+// in file order plus the synthetic ones of make_benchmark_catalog), and
+// writes benchmark.csv and benchmark.json. With --compare, cases whose
+// median is more than T (default 0.10) slower than in the baseline CSV, or
+// whose answer changed, are listed and the exit status is 1. Built with
+// -DMAXCALORIE_PROFILE ("make profile"), it also prints the PROFILE_SCOPE
+// regions of the solvers.
+
+// Total calories of the given positions of a catalog.
+static double total_calories(const FoodCatalog& foods, const FoodIndexVector& indices)
+{
+  double weight, calories;
+  sum_food_catalog(foods, indices, weight, calories);
+  return calories;
+}
+
+int main(int argc, char* argv[])
+{
+  bool quick = false, pin = true;
+  unsigned cpu = 0;
+  string csv_path = "benchmark.csv", json_path = "benchmark.json", label = "", baseline_path = "";
+  double tolerance = 0.10;
+
+  for (int k = 1; k < argc; k++)
+  {
+    string arg = argv[k];
+    bool has_value = k + 1 < argc;
+    if (arg == "--quick") quick = true;
+    else if (arg == "--no-pin") pin = false;
+    else if (arg == "--cpu" && has_value) cpu = atoi(argv[++k]);
+    else if (arg == "--csv" && has_value) csv_path = argv[++k];
+    else if (arg == "--json" && has_value) json_path = argv[++k];
+    else if (arg == "--label" && has_value) label = argv[++k];
+    else if (arg == "--compare" && has_value) baseline_path = argv[++k];
+    else if (arg == "--tolerance" && has_value) tolerance = atof(argv[++k]);
+    else
+    {
+      cout << "unknown or incomplete argument: " << arg << endl;
+      return 2;
+    }
+  }
+
+  // pin_to_cpu confines the threads started after it too, so the pool is
+  // started first, and the parallel cases get the saved CPUs back while
+  // they run (the caller of ThreadPool::run works as well).
+  ThreadPool pool(solver_thread_count(0));
+  const CpuAffinity all_cpus = current_cpu_affinity();
+  if (pin && !pin_to_cpu(cpu))
+  {
+    cout << "warning: could not pin to CPU " << cpu << "; timings may be noisier" << endl;
+    pin = false;
+  }
+
+  auto all_foods = load_food_catalog("food.csv");
+  if (!all_foods)
+  {
+    return 2;
+  }
+  FoodCatalog food = all_foods->subset(*filter_food_catalog(*all_foods, 1, 2500, all_foods->size()));
+
+  BenchmarkOptions options;
+  if (quick)
+  {
+    options.warmup = 1;
+    options.repeats = 5;
+    options.max_seconds = 0.2;
+  }
+
+  const size_t largest = quick ? 1000 : food.size();
+  vector<string> distributions = {"food", "uniform", "correlated", "duplicates"};
+  vector<size_t> exhaustive_sizes = quick ? vector<size_t>{8, 12, 16} : vector<size_t>{8, 12, 16, 20};
+  vector<size_t> mitm_sizes = quick ? vector<size_t>{16, 24} : vector<size_t>{16, 24, 32, 40};
+  vector<size_t> large_sizes = quick ? vector<size_t>{100, largest} : vector<size_t>{100, 1000, largest};
+  vector<double> capacities = quick ? vector<double>{500, 2000} : vector<double>{500, 2000, 10000};
+
+  SolverWorkspace workspace;
+  vector<BenchmarkResult> results;
+
+  for (const string& distribution : distributions)
+  {
+    FoodCatalog base = distribution == "food"
+      ? food.subset(*filter_food_catalog(food, 0, 1e300, largest))
+      : make_benchmark_catalog(distribution, largest);
+
+    // Runs one case on the first n items of this distribution.
+    FoodCatalog foods;
+    auto bench = [&](const string& solver, size_t n, double capacity, const function<double()>& solve)
+    {
+      results.push_back(run_benchmark(solver, distribution, n, capacity, solve, options));
+      const BenchmarkResult& r = results.back();
+      cout << solver << " " << distribution << " n=" << n << " W=" << capacity
+        << ": median " << r.median_seconds << "s, p99 " << r.p99_seconds << "s (" << r.repeats << " runs)" << endl;
+    };
+    // Runs a case on several threads, unpinned.
+    auto bench_unpinned = [&](const string& solver, size_t n, double capacity, const function<double()>& solve)
+    {
+      const bool unpinned = pin && restore_cpu_affinity(all_cpus);
+      bench(solver, n, capacity, solve);
+      if (unpinned)
+      {
+        pin_to_cpu(cpu);
+      }
+    };
+    auto first = [&](size_t n)
+    {
+      filter_food_catalog(base, -1e300, 1e300, n, workspace.indices);
+      base.subset(workspace.indices, foods);
+    };
+
+    for (size_t n : exhaustive_sizes)
+    {
+      first(n);
+      double capacity = 500;
+      bench("exhaustive", n, capacity, [&]() { exhaustive_max_calories(foods, capacity, workspace, workspace.best); return total_calories(foods, workspace.best); });
+      bench("exhaustive_gray", n, capacity, [&]() { exhaustive_max_calories_gray(foods, capacity, workspace.best); return total_calories(foods, workspace.best); });
+      bench_unpinned("exhaustive_parallel", n, capacity, [&]() { return total_calories(foods, *exhaustive_max_calories_parallel(foods, capacity)); });
+    }
+
+    for (size_t n : mitm_sizes)
+    {
+      first(n);
+      double capacity = 500;
+      bench("mitm", n, capacity, [&]() { return total_calories(foods, *mitm_max_calories(foods, capacity)); });
+    }
+
+    for (size_t n : large_sizes)
+    {
+      first(n);
+      for (double capacity : capacities)
+      {
+        // Branch and bound is exponential on the duplicates catalog, so it
+        // gets a node limit; past it the value is only the best found. A
+        // time limit would make that value, which --compare checks, depend
+        // on the machine.
+        BranchBoundLimits limits;
+        limits.max_nodes = 2000000;
+        bench("branch_bound", n, capacity, [&]() { return total_calories(foods, *branch_bound_max_calories(foods, capacity, limits)); });
+        bench("greedy", n, capacity, [&]() { greedy_max_calories(foods, capacity, workspace, workspace.best); return total_calories(foods, workspace.best); });
+        bench("dynamic_rolling", n, capacity, [&]() { dynamic_max_calories_rolling(foods, capacity, workspace, workspace.best); return total_calories(foods, workspace.best); });
+        bench("dynamic_fixed", n, capacity, [&]() { dynamic_max_calories_fixed(foods, capacity, workspace, workspace.best); return total_calories(foods, workspace.best); });
+        bench_unpinned("dynamic_parallel", n, capacity, [&]() { return total_calories(foods, *dynamic_max_calories_parallel(foods, capacity, pool)); });
+        bench("dynamic_linear_memory", n, capacity, [&]() { return total_calories(foods, *dynamic_max_calories_linear_memory(foods, capacity)); });
+        bench("bounded", n, capacity, [&]()
+        {
+          auto best = bounded_max_calories(foods, capacity);
+          double calories = 0;
+          for (const FoodQuantity& chosen : *best)
+          {
+            calories += chosen.count * foods.foodCalories(chosen.index);
+          }
+          return calories;
+        });
+
+        // The full table is (n + 1) x (W + 1) doubles; keep it under 256 MB.
+        if ((n + 1) * (capacity + 1) * sizeof(double) <= (256 << 20))
+        {
+          bench("dynamic", n, capacity, [&]() { dynamic_max_calories(foods, capacity, workspace, workspace.best); return total_calories(foods, workspace.best); });
+        }
+      }
+
+      // Twenty capacities from one shared DP pass.
+      vector<double> batch;
+      for (int k = 1; k <= 20; k++)
+      {
+        batch.push_back(100 * k);
+      }
+      bench("dynamic_batch", n, batch.back(), [&]()
+      {
+        dynamic_max_calories_batch(foods, batch, workspace, workspace.results);
+        double calories = 0;
+        for (const FoodIndexVector& result : workspace.results)
+        {
+          calories += total_calories(foods, result);
+        }
+        return calories;
+      });
+
+      bench("incremental", n, 2000, [&]()
+      {
+        IncrementalDynamicSolver solver(2000);
+        solver.add_catalog(foods);
+        return solver.best_calories(2000);
+      });
+    }
+  }
+
+  ofstream csv(csv_path);
+  write_benchmark_csv(csv, results);
+  csv.close();
+  ofstream json(json_path);
+  write_benchmark_json(json, label, results);
+  json.close();
+  cout << "wrote " << results.size() << " cases to " << csv_path << " and " << json_path << endl;
+
+#ifdef MAXCALORIE_PROFILE
+  print_profile_report(cout);
+#endif
+
+  if (!baseline_path.empty())
+  {
+    vector<BenchmarkResult> baseline;
+    if (!read_benchmark_csv(baseline_path, baseline))
+    {
+      cout << "cannot read baseline " << baseline_path << endl;
+      return 2;
+    }
+    vector<string> regressions = compare_benchmarks(baseline, results, tolerance);
+    for (const string& regression : regressions)
+    {
+      cout << "REGRESSION " << regression << endl;
+    }
+    cout << regressions.size() << " regressions against " << baseline_path << endl;
+    return regressions.empty() ? 0 : 1;
+  }
+
+  return 0;
+}
@@ -3,8 +3,8 @@
 #include <iomanip>
 #include <fstream>
 
+#include "benchmark.hh"
 #include "maxcalorie.hh"
-#include "timer.hh"
 
 using namespace std;
 
@@ -14,17 +14,30 @@ int main()
   exhaustive << "n,seconds" << endl;
   exhaustive << fixed << setprecision(10);
 
-  auto all_foods = load_food_database("food.csv");
-  auto filtered_foods = filter_food_vector(*all_foods, 1, 2500, all_foods->size());
+  auto all_foods = load_food_catalog("food.csv");
+  FoodCatalog filtered_foods = all_foods->subset(*filter_food_catalog(*all_foods, 1, 2500, all_foods->size()));
+
+  // One workspace for every solve below: once it has grown to the largest
+  // n, the timed calls allocate nothing. Each point is the median of several
+  // runs after a warm-up, on one pinned CPU.
+  SolverWorkspace workspace;
+  BenchmarkOptions options;
+  options.repeats = 9;
+  options.max_seconds = 0.5;
+  pin_to_cpu(0);
 
   for(int i = 0; i < 22; i++)
   {
     int n = i + 1;
-    auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+    filter_food_catalog(filtered_foods, 1, 2000, n, workspace.indices);
+    filtered_foods.subset(workspace.indices, workspace.catalog);
 
-    Timer timer;
-    auto solution = exhaustive_max_calories(*small_foods, 2000);
-    exhaustive << n << "," << timer.elapsed() << endl;
+    auto result = run_benchmark("exhaustive", "food", n, 2000, [&]()
+    {
+      exhaustive_max_calories(workspace.catalog, 2000, workspace, workspace.best);
+      return 0.0;
+    }, options);
+    exhaustive << n << "," << result.median_seconds << endl;
   }
   exhaustive.close();
 
@@ -37,12 +50,38 @@ int main()
   for(int i = 0; i < 200; i++)
   {
     int n = i + 1;
-    auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+    filter_food_catalog(filtered_foods, 1, 2000, n, workspace.indices);
+    filtered_foods.subset(workspace.indices, workspace.catalog);
 
-    Timer timer;
-    auto solution = dynamic_max_calories(*small_foods, 2000);
-    dynamic << n << "," << timer.elapsed() << endl;
+    auto result = run_benchmark("dynamic", "food", n, 2000, [&]()
+    {
+      dynamic_max_calories(workspace.catalog, 2000, workspace, workspace.best);
+      return 0.0;
+    }, options);
+    dynamic << n << "," << result.median_seconds << endl;
   }
   dynamic.close();
 
+  ofstream greedy("greedy.csv");
+  greedy << "n,seconds,calories,upper_bound" << endl;
+  greedy << fixed << setprecision(10);
+
+  for(int i = 0; i < 200; i++)
+  {
+    int n = i + 1;
+    filter_food_catalog(filtered_foods, 1, 2000, n, workspace.indices);
+    filtered_foods.subset(workspace.indices, workspace.catalog);
+
+    double upper_bound;
+    auto result = run_benchmark("greedy", "food", n, 2000, [&]()
+    {
+      greedy_max_calories(workspace.catalog, 2000, workspace, workspace.best, &upper_bound);
+      double weight, calories;
+      sum_food_catalog(workspace.catalog, workspace.best, weight, calories);
+      return calories;
+    }, options);
+    greedy << n << "," << result.median_seconds << "," << result.value << "," << upper_bound << endl;
+  }
+  greedy.close();
+
 }
@@ -7,9 +7,12 @@
 
 
 #include <cassert>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 
 
+#include "benchmark.hh"
 #include "maxcalorie.hh"
 #include "rubrictest.hh"
 
@@ -37,6 +40,104 @@ int main()
 		}
 	);
 	
+	//
+	rubric.criterion(
+		"load_food_catalog and invalid rows", 2,
+		[&]()
+		{
+			auto catalog = load_food_catalog("food.csv");
+			TEST_TRUE("non-null", catalog);
+			TEST_EQUAL("size", all_foods->size(), catalog->size());
+			for (size_t i = 0; i < catalog->size(); i++)
+			{
+				TEST_EQUAL("description", (*all_foods)[i]->description(), catalog->description(i));
+				TEST_EQUAL("weight", (*all_foods)[i]->weight(), catalog->weight(i));
+				TEST_EQUAL("calories", (*all_foods)[i]->foodCalories(), catalog->foodCalories(i));
+			}
+
+			const char* path = "maxcalorie_test_invalid.csv";
+			{
+				std::ofstream f(path);
+				f
+					<< "Item^Weight^foodCalories\n"
+					<< "good beans^10^100.5\n"
+					<< "bad weight^ten^100\n"
+					<< "trailing junk^10^100x\n"
+					<< "zero weight^0^100\n"
+					<< "negative weight^-3^100\n"
+					<< "good rice^ 4 ^20\r\n"
+					;
+			}
+			auto fast = load_food_catalog(path);
+			auto slow = load_food_database(path);
+			std::remove(path);
+
+			TEST_TRUE("non-null", fast);
+			TEST_TRUE("non-null", slow);
+			TEST_EQUAL("bad rows skipped", 2, fast->size());
+			TEST_EQUAL("bad rows skipped", 2, slow->size());
+			TEST_EQUAL("contents", "good beans", fast->description(0));
+			TEST_EQUAL("contents", "good rice", fast->description(1));
+			TEST_EQUAL("contents", 4, fast->weight(1));
+			TEST_EQUAL("contents", "good beans", (*slow)[0]->description());
+			TEST_EQUAL("contents", 20, (*slow)[1]->foodCalories());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"food catalog snapshots", 2,
+		[&]()
+		{
+			auto catalog = load_food_catalog("food.csv");
+			const char* path = "maxcalorie_test_snapshot.bin";
+
+			TEST_TRUE("saved", save_food_snapshot(*catalog, path));
+			auto snapshot = load_food_snapshot(path);
+			TEST_TRUE("non-null", snapshot);
+			TEST_EQUAL("size", catalog->size(), snapshot->size());
+			for (size_t i = 0; i < catalog->size(); i++)
+			{
+				TEST_EQUAL("description", catalog->description(i), snapshot->description(i));
+				TEST_EQUAL("weight", catalog->weight(i), snapshot->weight(i));
+				TEST_EQUAL("calories", catalog->foodCalories(i), snapshot->foodCalories(i));
+			}
+			TEST_FALSE("stale source size", load_food_snapshot(path, 1));
+
+			// The first call writes a fresh snapshot, the second one reads it.
+			std::remove(path);
+			auto first = load_food_catalog("food.csv", path);
+			auto second = load_food_catalog("food.csv", path);
+			TEST_TRUE("non-null", first);
+			TEST_TRUE("non-null", second);
+			TEST_EQUAL("size", catalog->size(), second->size());
+			TEST_EQUAL("contents", catalog->description(catalog->size() - 1), second->description(second->size() - 1));
+
+			{
+				std::ofstream f(path, std::ios::binary | std::ios::trunc);
+				f << "not a snapshot";
+			}
+			TEST_FALSE("bad magic", load_food_snapshot(path));
+
+			// The offsets come just before the 6-byte pool; put the second
+			// one past the end of it.
+			FoodCatalog three;
+			three.push_back("a", 1, 1);
+			three.push_back("bb", 2, 2);
+			three.push_back("ccc", 3, 3);
+			TEST_TRUE("saved", save_food_snapshot(three, path));
+			TEST_TRUE("intact", load_food_snapshot(path));
+			{
+				std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out | std::ios::ate);
+				const uint64_t past_the_pool = 1000;
+				f.seekp(uint64_t(f.tellp()) - 6 - 4 * sizeof(uint64_t) + sizeof(uint64_t));
+				f.write(reinterpret_cast<const char*>(&past_the_pool), sizeof(past_the_pool));
+			}
+			TEST_FALSE("offsets out of order", load_food_snapshot(path));
+			std::remove(path);
+		}
+	);
+
 	//
 	rubric.criterion(
 		"filter_food_vector", 2,
@@ -60,6 +161,43 @@ int main()
 		}
 	);
 	
+	//
+	rubric.criterion(
+		"FoodCatalog", 2,
+		[&]()
+		{
+			FoodCatalog catalog(*all_foods);
+			TEST_EQUAL("size", all_foods->size(), catalog.size());
+			for (size_t i = 0; i < catalog.size(); i++)
+			{
+				TEST_EQUAL("description", (*all_foods)[i]->description(), catalog.description(i));
+				TEST_EQUAL("weight", (*all_foods)[i]->weight(), catalog.weight(i));
+				TEST_EQUAL("calories", (*all_foods)[i]->foodCalories(), catalog.foodCalories(i));
+			}
+
+			auto ten = filter_food_vector(*all_foods, 100, 500, 10);
+			auto ten_indices = filter_food_catalog(catalog, 100, 500, 10);
+			TEST_TRUE("non-null", ten_indices);
+			TEST_EQUAL("total_size", 10, ten_indices->size());
+			auto selected = select_food_vector(*all_foods, *ten_indices);
+			for (size_t i = 0; i < ten->size(); i++)
+			{
+				TEST_EQUAL("same items", (*ten)[i], (*selected)[i]);
+			}
+
+			FoodCatalog small = catalog.subset(*ten_indices);
+			TEST_EQUAL("subset size", 10, small.size());
+			TEST_EQUAL("subset contents", "Idaho bread", small.description(9));
+			FoodIndexVector last = {9};
+			remap_food_indices(*ten_indices, last);
+			TEST_EQUAL("remap", (*ten_indices)[9], last[0]);
+
+			auto copies = small.to_food_vector();
+			TEST_EQUAL("to_food_vector size", 10, copies->size());
+			TEST_EQUAL("to_food_vector contents", "refried spicy beans", (*copies)[0]->description());
+		}
+	);
+
 	//
 	
     	//
@@ -129,6 +267,834 @@ int main()
 		}
 	);
 	
+	//
+	rubric.criterion(
+		"dynamic_max_calories_rolling matches dynamic_max_calories", 2,
+		[&]()
+		{
+			for (double total_weight : {3.0, 9.0, 10.0, 14.0})
+			{
+				auto expected = dynamic_max_calories(trivial_foods, total_weight);
+				auto soln = dynamic_max_calories_rolling(trivial_foods, total_weight);
+				TEST_TRUE("non-null", soln);
+				TEST_EQUAL("trivial size", expected->size(), soln->size());
+				for (size_t i = 0; i < soln->size(); i++)
+				{
+					TEST_EQUAL("trivial contents", (*expected)[i], (*soln)[i]);
+				}
+			}
+
+			for (double total_weight : {500.0, 5000.0})
+			{
+				auto expected = dynamic_max_calories(*filtered_foods, total_weight);
+				auto soln = dynamic_max_calories_rolling(*filtered_foods, total_weight);
+				TEST_TRUE("non-null", soln);
+				TEST_EQUAL("same size", expected->size(), soln->size());
+				for (size_t i = 0; i < soln->size(); i++)
+				{
+					TEST_EQUAL("same items", (*expected)[i], (*soln)[i]);
+				}
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"dynamic_max_calories take-all and prefix-weight limits", 2,
+		[&]()
+		{
+			// Everything fits: every item with calories is taken, in traceback order.
+			FoodCatalog light;
+			light.push_back("a", 2, 10);
+			light.push_back("water", 3, 0);
+			light.push_back("b", 4, 30);
+			for (double total_weight : {9.0, 100.0, 1e6})
+			{
+				auto all = dynamic_max_calories(light, total_weight);
+				TEST_EQUAL("take-all size", 2, all->size());
+				TEST_EQUAL("take-all first", 2, (*all)[0]);
+				TEST_EQUAL("take-all second", 0, (*all)[1]);
+				auto rolling = dynamic_max_calories_rolling(light, total_weight);
+				TEST_TRUE("rolling take-all", *all == *rolling);
+			}
+
+			// One item heavier than the capacity, a few zero-calorie items and
+			// a capacity above most prefix weights: the limited DPs still match
+			// exhaustive search and each other.
+			FoodCatalog mixed;
+			for (size_t i = 0; i < 14; i++)
+			{
+				mixed.push_back("item " + std::to_string(i), 1 + (i * 7) % 11, (i % 5 == 0) ? 0 : 10 + (i * 13) % 37);
+			}
+			mixed.push_back("anvil", 500, 1000);
+			mixed.push_back("crumb", 1, 3);
+			for (double total_weight : {0.0, 5.0, 20.0, 40.0, 70.0})
+			{
+				double weight, expected, calories;
+				sum_food_catalog(mixed, *exhaustive_max_calories(mixed, total_weight), weight, expected);
+				auto table = dynamic_max_calories(mixed, total_weight);
+				sum_food_catalog(mixed, *table, weight, calories);
+				TEST_LE("fits", weight, total_weight);
+				TEST_EQUAL("table optimal", expected, calories);
+				auto rolling = dynamic_max_calories_rolling(mixed, total_weight);
+				TEST_TRUE("rolling same items", *table == *rolling);
+			}
+
+			std::vector<double> capacities = {70.0, 5.0, 40.0};
+			auto batch = dynamic_max_calories_batch(mixed, capacities);
+			for (size_t k = 0; k < capacities.size(); k++)
+			{
+				TEST_TRUE("batch same items", *batch[k] == *dynamic_max_calories(mixed, capacities[k]));
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"dynamic_max_calories_linear_memory", 2,
+		[&]()
+		{
+			std::unique_ptr<FoodVector> soln;
+
+			soln = dynamic_max_calories_linear_memory(trivial_foods, 3);
+			TEST_TRUE("non-null", soln);
+			TEST_TRUE("empty solution", soln->empty());
+
+			soln = dynamic_max_calories_linear_memory(trivial_foods, 9);
+			TEST_EQUAL("pasta only", 1, soln->size());
+			TEST_EQUAL("pasta only", "test pasta", (*soln)[0]->description());
+
+			soln = dynamic_max_calories_linear_memory(trivial_foods, 14);
+			TEST_EQUAL("corn and pasta", 2, soln->size());
+			TEST_EQUAL("corn and pasta", "test pasta", (*soln)[0]->description());
+			TEST_EQUAL("corn and pasta", "test whole corn", (*soln)[1]->description());
+
+			for (double total_weight : {500.0, 5000.0})
+			{
+				auto expected = dynamic_max_calories_rolling(*filtered_foods, total_weight);
+				soln = dynamic_max_calories_linear_memory(*filtered_foods, total_weight);
+				TEST_TRUE("non-null", soln);
+
+				double expected_weight, expected_calories, actual_weight, actual_calories;
+				sum_food_vector(*expected, expected_weight, expected_calories);
+				sum_food_vector(*soln, actual_weight, actual_calories);
+				TEST_LE("fits", actual_weight, total_weight);
+				TEST_EQUAL("optimal calories",
+					std::round(expected_calories * 100) / 100,
+					std::round(actual_calories * 100) / 100);
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"FoodCalorieIndex", 2,
+		[&]()
+		{
+			FoodCatalog catalog(*all_foods);
+			FoodCalorieIndex index(catalog);
+
+			FoodIndexSpan span = index.range(100, 500);
+			auto everything = filter_food_catalog(catalog, 100, 500, catalog.size());
+			TEST_EQUAL("range size", everything->size(), span.size());
+			for (size_t k = 0; k < span.size(); k++)
+			{
+				TEST_TRUE("in range", catalog.foodCalories(span[k]) >= 100 && catalog.foodCalories(span[k]) <= 500);
+				TEST_TRUE("sorted", k == 0 || catalog.foodCalories(span[k - 1]) <= catalog.foodCalories(span[k]));
+			}
+			TEST_TRUE("empty range", index.range(500, 100).empty());
+			TEST_TRUE("nothing that big", index.range(1e12, 1e13).empty());
+
+			// Narrow ranges use the index, wide ones the scan; both must
+			// agree with filter_food_catalog.
+			for (auto bounds : std::vector<std::pair<double, double>>{{100, 500}, {0, 1e9}, {250, 251}, {1e6, 1e7}})
+			{
+				for (int total_size : {1, 10, 300, int(catalog.size())})
+				{
+					auto expected = filter_food_catalog(catalog, bounds.first, bounds.second, total_size);
+					auto actual = index.filter(bounds.first, bounds.second, total_size);
+					TEST_TRUE("same as filter_food_catalog", *expected == *actual);
+				}
+			}
+			TEST_FALSE("invalid total size", index.filter(100, 500, 0));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"prune_dominated_items", 2,
+		[&]()
+		{
+			FoodVector foods;
+			foods.push_back(std::make_shared<FoodItem>("a", 2, 10));
+			foods.push_back(std::make_shared<FoodItem>("b", 2, 30));
+			foods.push_back(std::make_shared<FoodItem>("c", 2, 20));
+			foods.push_back(std::make_shared<FoodItem>("d", 2, 30));
+			foods.push_back(std::make_shared<FoodItem>("e", 9, 500));
+			foods.push_back(std::make_shared<FoodItem>("f", 1, 0));
+			foods.push_back(std::make_shared<FoodItem>("g", 1, 5));
+			FoodCatalog small(foods);
+			PruneStats stats;
+			auto kept = prune_dominated_items(small, 5, &stats);
+			// Two items of weight 2 fit in 5: the 30s; ties go to the earliest.
+			TEST_TRUE("kept", *kept == FoodIndexVector({1, 3, 6}));
+			TEST_EQUAL("input", 7, stats.input_items);
+			TEST_EQUAL("kept count", 3, stats.kept_items);
+			TEST_EQUAL("over capacity", 1, stats.over_capacity);
+			TEST_EQUAL("no calories", 1, stats.no_calories);
+			TEST_EQUAL("dominated", 2, stats.dominated);
+			TEST_EQUAL("exact quotient keeps k", 3, prune_dominated_items(small, 6)->size() - 1);
+
+			// The catalog has many duplicate weights, so small capacities
+			// shrink it a lot without changing the optimum.
+			FoodCatalog catalog(*all_foods);
+			prune_dominated_items(catalog, 100, &stats);
+			TEST_LT("most rows pruned", stats.kept_items * 2, stats.input_items);
+
+			auto indices = filter_food_catalog(catalog, 1, 2500, 300);
+			FoodCatalog subset = catalog.subset(*indices);
+			for (double total_weight : {20.0, 100.0, 500.0})
+			{
+				auto pruned = prune_dominated_items(subset, total_weight);
+				double full_weight, full_calories, pruned_weight, pruned_calories;
+				sum_food_catalog(subset, *dynamic_max_calories_rolling(subset, total_weight), full_weight, full_calories);
+				FoodCatalog smaller = subset.subset(*pruned);
+				sum_food_catalog(smaller, *dynamic_max_calories_rolling(smaller, total_weight), pruned_weight, pruned_calories);
+				TEST_EQUAL("same optimum", full_calories, pruned_calories);
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"quantities and bounded_max_calories", 2,
+		[&]()
+		{
+			const char* path = "maxcalorie_test_quantity.csv";
+			{
+				std::ofstream f(path);
+				f
+					<< "Item^Weight^foodCalories^Quantity\n"
+					<< "beans^3^40^50\n"
+					<< "rice^5^70^2\n"
+					<< "no stock^1^100^0\n"
+					<< "half a can^1^100^1.5\n"
+					<< "tuna^4^55^1\n"
+					;
+			}
+			auto fast = load_food_catalog(path);
+			auto slow = load_food_database(path);
+			TEST_TRUE("non-null", fast);
+			TEST_TRUE("non-null", slow);
+			TEST_EQUAL("bad quantities skipped", 3, fast->size());
+			TEST_EQUAL("bad quantities skipped", 3, slow->size());
+			TEST_EQUAL("quantity", 50, fast->quantity(0));
+			TEST_EQUAL("quantity", 2, (*slow)[1]->quantity());
+			TEST_EQUAL("default quantity", 1, (*all_foods)[0]->quantity());
+
+			const char* snapshot_path = "maxcalorie_test_quantity.bin";
+			TEST_TRUE("saved", save_food_snapshot(*fast, snapshot_path));
+			auto snapshot = load_food_snapshot(snapshot_path);
+			std::remove(snapshot_path);
+			TEST_TRUE("snapshot", snapshot);
+			TEST_EQUAL("snapshot quantity", 50, snapshot->quantity(0));
+			TEST_EQUAL("snapshot hash", fast->content_hash(), snapshot->content_hash());
+
+			{
+				std::ofstream f(path);
+				f << "Item^Weight^foodCalories^Colour\n" << "beans^3^40^red\n";
+			}
+			TEST_FALSE("unknown column", load_food_catalog(path));
+			TEST_FALSE("unknown column", load_food_database(path));
+			std::remove(path);
+
+			// Same optimum as repeating every row quantity times.
+			for (double total_weight : {0.0, 2.0, 11.0, 37.0, 200.0})
+			{
+				FoodCatalog expanded;
+				for (size_t i = 0; i < fast->size(); i++)
+				{
+					for (uint32_t k = 0; k < fast->quantity(i); k++)
+					{
+						expanded.push_back(fast->description(i), fast->weight(i), fast->foodCalories(i));
+					}
+				}
+				double expected_weight, expected_calories;
+				sum_food_catalog(expanded, *dynamic_max_calories_rolling(expanded, total_weight), expected_weight, expected_calories);
+
+				auto bounded = bounded_max_calories(*fast, total_weight);
+				double weight = 0, calories = 0;
+				for (size_t k = 0; k < bounded->size(); k++)
+				{
+					const FoodQuantity& chosen = (*bounded)[k];
+					TEST_TRUE("ascending", k == 0 || (*bounded)[k - 1].index < chosen.index);
+					TEST_TRUE("within stock", chosen.count >= 1 && chosen.count <= fast->quantity(chosen.index));
+					weight += chosen.count * fast->weight(chosen.index);
+					calories += chosen.count * fast->foodCalories(chosen.index);
+				}
+				TEST_LE("fits", weight, total_weight);
+				TEST_EQUAL("optimal", expected_calories, calories);
+
+				auto foods = bounded_max_calories(*slow, total_weight);
+				sum_food_vector(*foods, weight, calories);
+				TEST_EQUAL("FoodVector adapter", expected_calories, calories);
+			}
+			TEST_TRUE("everything fits", *bounded_max_calories(*fast, 1000) == FoodQuantityVector({{0, 50}, {1, 2}, {2, 1}}));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"SolverWorkspace", 2,
+		[&]()
+		{
+			FoodCatalog catalog(*all_foods);
+			SolverWorkspace& workspace = thread_solver_workspace();
+			TEST_TRUE("one per thread", &workspace == &thread_solver_workspace());
+
+			TEST_TRUE("filter", filter_food_catalog(catalog, 1, 2500, 300, workspace.indices));
+			TEST_TRUE("same filter", workspace.indices == *filter_food_catalog(catalog, 1, 2500, 300));
+			TEST_FALSE("invalid total size", filter_food_catalog(catalog, 1, 2500, 0, workspace.indices));
+			TEST_TRUE("cleared", workspace.indices.empty());
+
+			FoodIndexVector indices = *filter_food_catalog(catalog, 1, 2500, 300);
+			catalog.subset(indices, workspace.catalog);
+			TEST_EQUAL("same subset", catalog.subset(indices).content_hash(), workspace.catalog.content_hash());
+			const FoodCatalog& foods = workspace.catalog;
+			FoodIndexVector best;
+
+			// Results match the allocating overloads, and a second identical
+			// solve reuses the same buffers.
+			dynamic_max_calories_rolling(foods, 500, workspace, best);
+			TEST_TRUE("rolling", best == *dynamic_max_calories_rolling(foods, 500));
+			const uint64_t* take = workspace.take.data();
+			const size_t* best_storage = best.data();
+			dynamic_max_calories_rolling(foods, 500, workspace, best);
+			TEST_TRUE("take reused", take == workspace.take.data());
+			TEST_TRUE("result reused", best_storage == best.data());
+
+			FoodCatalog small = foods.subset(FoodIndexVector({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+			dynamic_max_calories(small, 500, workspace, best);
+			TEST_TRUE("dynamic", best == *dynamic_max_calories(small, 500));
+			greedy_max_calories(foods, 500, workspace, best);
+			TEST_TRUE("greedy", best == *greedy_max_calories(foods, 500));
+			exhaustive_max_calories(small, 100, workspace, best);
+			TEST_TRUE("exhaustive", best == *exhaustive_max_calories(small, 100));
+			exhaustive_max_calories_gray(small, 100, best);
+			TEST_TRUE("gray", best == *exhaustive_max_calories_gray(small, 100));
+
+			std::vector<double> capacities = {-1, 0, 100, 500};
+			dynamic_max_calories_batch(foods, capacities, workspace, workspace.results);
+			auto expected = dynamic_max_calories_batch(foods, capacities);
+			TEST_EQUAL("batch size", capacities.size(), workspace.results.size());
+			for (size_t k = 0; k < capacities.size(); k++)
+			{
+				TEST_TRUE("batch", workspace.results[k] == *expected[k]);
+			}
+
+			workspace.catalog.clear();
+			TEST_TRUE("clear", workspace.catalog.empty());
+			TEST_EQUAL("clear resets the hash", FoodCatalog().content_hash(), workspace.catalog.content_hash());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"dynamic_max_calories weight resolution", 2,
+		[&]()
+		{
+			FoodVector fractional;
+			fractional.push_back(std::shared_ptr<FoodItem>(new FoodItem("half can", 2.5, 10)));
+			fractional.push_back(std::shared_ptr<FoodItem>(new FoodItem("other half can", 2.5, 10)));
+			fractional.push_back(std::shared_ptr<FoodItem>(new FoodItem("brick", 5, 15)));
+
+			// Whole ounces round the cans up to 3 ounces each, so they no longer
+			// fit together.
+			auto coarse = dynamic_max_calories(fractional, 5);
+			TEST_EQUAL("whole ounces", 1, coarse->size());
+			TEST_EQUAL("whole ounces", "brick", (*coarse)[0]->description());
+
+			auto fine = dynamic_max_calories(fractional, 5, 0.5);
+			auto fine_rolling = dynamic_max_calories_rolling(fractional, 5, 0.1);
+			auto fine_linear = dynamic_max_calories_linear_memory(fractional, 5, 0.1);
+			TEST_EQUAL("half ounces", 2, fine->size());
+			TEST_EQUAL("tenths", 2, fine_rolling->size());
+			TEST_EQUAL("tenths", 2, fine_linear->size());
+
+			// Rounding never produces an infeasible answer.
+			auto tight = dynamic_max_calories(fractional, 4.9, 0.5);
+			TEST_EQUAL("rounded down capacity", 1, tight->size());
+			TEST_EQUAL("rounded down capacity", "half can", (*tight)[0]->description());
+
+			DynamicCost cost = estimate_dynamic_cost(2, 14);
+			TEST_EQUAL("capacity units", 14, cost.capacity_units);
+			TEST_EQUAL("cells", 30, cost.cells);
+			TEST_EQUAL("table bytes", 3 * 15 * sizeof(double), cost.table_bytes);
+			TEST_EQUAL("finer resolution", 140, estimate_dynamic_cost(2, 14, 0.1).capacity_units);
+			TEST_LT("rolling is smaller",
+				estimate_dynamic_cost(8064, 5000).rolling_bytes * 32,
+				estimate_dynamic_cost(8064, 5000).table_bytes);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"dynamic_max_calories_fixed", 2,
+		[&]()
+		{
+			auto catalog = load_food_catalog("food.csv");
+			FoodCatalog foods = catalog->subset(*filter_food_catalog(*catalog, 1, 2500, 1000));
+			std::vector<uint64_t> values;
+			const uint64_t total = dp_fixed_point_calories(foods, 100, values);
+			TEST_LT("food.csv fits uint32_t", total, uint64_t(UINT32_MAX));
+			for (size_t i = 0; i < foods.size(); i++)
+			{
+				TEST_EQUAL("two decimals are exact", foods.foodCalories(i), values[i] / 100.0);
+			}
+
+			SolverWorkspace workspace;
+			FoodIndexVector best;
+			for (double total_weight : {-1.0, 0.0, 100.0, 500.0, 2000.0})
+			{
+				auto expected = dynamic_max_calories_rolling(foods, total_weight);
+				dynamic_max_calories_fixed(foods, total_weight, workspace, best);
+				double weight, expected_weight, calories, expected_calories;
+				sum_food_catalog(foods, *expected, expected_weight, expected_calories);
+				sum_food_catalog(foods, best, weight, calories);
+				TEST_LE("fits", weight, std::max(total_weight, 0.0));
+				TEST_TRUE("same calories", std::abs(calories - expected_calories) < 1e-6);
+				TEST_TRUE("descending", std::is_sorted(best.rbegin(), best.rend()));
+			}
+
+			// Floating point sees 0.1 + 0.2 as better than 0.3; fixed point
+			// sees the tie and keeps the first item.
+			FoodCatalog tie;
+			tie.push_back("three tenths", 2, 0.3);
+			tie.push_back("one tenth", 1, 0.1);
+			tie.push_back("two tenths", 1, 0.2);
+			TEST_EQUAL("double DP", 2, dynamic_max_calories_rolling(tie, 2)->size());
+			TEST_TRUE("exact tie", *dynamic_max_calories_fixed(tie, 2) == FoodIndexVector({0}));
+
+			// Past 2^32 in total, the rows are 64-bit.
+			FoodCatalog big;
+			for (size_t i = 0; i < 40; i++)
+			{
+				big.push_back("big " + std::to_string(i), 1 + (i * 7) % 13, 5e6 + 1e5 * ((i * 11) % 17));
+			}
+			TEST_GT("needs uint64_t", dp_fixed_point_calories(big, 100, values), uint64_t(UINT32_MAX));
+			for (double total_weight : {10.0, 60.0, 200.0})
+			{
+				auto fixed = dynamic_max_calories_fixed(big, total_weight);
+				double weight, calories, expected_calories;
+				sum_food_catalog(big, *fixed, weight, calories);
+				sum_food_catalog(big, *dynamic_max_calories_rolling(big, total_weight), weight, expected_calories);
+				TEST_EQUAL("uint64_t optimum", expected_calories, calories);
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"dp_row_update kernels match the scalar kernel", 2,
+		[&]()
+		{
+			const size_t width = 203;
+			std::vector<double> prev(width);
+			std::vector<uint32_t> prev_int(width);
+			for (size_t j = 0; j < width; j++)
+			{
+				prev[j] = double((j * 37) % 101) + j;
+				prev_int[j] = uint32_t(prev[j]);
+			}
+
+			for (size_t w : {1, 2, 3, 5, 8, 64, 150, 300})
+			{
+				for (size_t lo : {0, 7, 64})
+				{
+					std::vector<double> expected(width, -1), actual(width, -1);
+					std::vector<uint64_t> expected_take(4, 0), actual_take(4, 0);
+					dp_row_update_scalar(prev.data(), expected.data(), lo, width, w, 40.0, expected_take.data());
+					dp_row_update(prev.data(), actual.data(), lo, width, w, 40.0, actual_take.data());
+					TEST_TRUE("double values", expected == actual);
+					TEST_TRUE("double take bits", expected_take == actual_take);
+
+					std::vector<double> in_place = prev;
+					std::fill(actual_take.begin(), actual_take.end(), 0);
+					dp_row_update(in_place.data(), in_place.data(), lo, width, w, 40.0, actual_take.data());
+					std::copy(prev.begin(), prev.begin() + lo, expected.begin());
+					TEST_TRUE("in place", expected == in_place);
+					TEST_TRUE("in place take bits", expected_take == actual_take);
+
+					std::vector<uint32_t> expected_int(width, 0), actual_int(width, 0);
+					std::fill(expected_take.begin(), expected_take.end(), 0);
+					std::fill(actual_take.begin(), actual_take.end(), 0);
+					dp_row_update_scalar(prev_int.data(), expected_int.data(), lo, width, w, uint32_t(40), expected_take.data());
+					dp_row_update(prev_int.data(), actual_int.data(), lo, width, w, uint32_t(40), actual_take.data());
+					TEST_TRUE("integer values", expected_int == actual_int);
+					TEST_TRUE("integer take bits", expected_take == actual_take);
+
+					// 64-bit values past 2^32, where a 32-bit lane would wrap.
+					std::vector<uint64_t> prev_wide(prev_int.begin(), prev_int.end()), expected_wide(width, 0), actual_wide(width, 0);
+					for (uint64_t& value : prev_wide)
+					{
+						value += uint64_t(1) << 40;
+					}
+					std::fill(expected_take.begin(), expected_take.end(), 0);
+					std::fill(actual_take.begin(), actual_take.end(), 0);
+					dp_row_update_scalar(prev_wide.data(), expected_wide.data(), lo, width, w, uint64_t(40), expected_take.data());
+					dp_row_update(prev_wide.data(), actual_wide.data(), lo, width, w, uint64_t(40), actual_take.data());
+					TEST_TRUE("64-bit values", expected_wide == actual_wide);
+					TEST_TRUE("64-bit take bits", expected_take == actual_take);
+				}
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"dynamic_max_calories_parallel matches dynamic_max_calories_rolling", 2,
+		[&]()
+		{
+			ThreadPool pool(4);
+			TEST_EQUAL("pool size", 4, pool.size());
+
+			// Small enough to fall back to one thread, then wide enough for
+			// several blocks per thread.
+			auto small_foods = filter_food_vector(*filtered_foods, 1, 2500, 300);
+			for (double total_weight : {14.0, 5000.0, 40000.0})
+			{
+				for (const FoodVector* foods : {&trivial_foods, small_foods.get()})
+				{
+					auto expected = dynamic_max_calories_rolling(*foods, total_weight);
+					auto soln = dynamic_max_calories_parallel(*foods, total_weight, pool);
+					TEST_TRUE("non-null", soln);
+					TEST_EQUAL("same size", expected->size(), soln->size());
+					for (size_t i = 0; i < soln->size(); i++)
+					{
+						TEST_EQUAL("same items", (*expected)[i], (*soln)[i]);
+					}
+				}
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"two-constraint solvers and Volume/Cost columns", 2,
+		[&]()
+		{
+			const char* path = "maxcalorie_test_volume.csv";
+			{
+				std::ofstream f(path);
+				f
+					<< "Item^Weight^foodCalories^Cost^Volume\n"
+					<< "rice^10^300^2.5^4\n"
+					<< "negative volume^1^1^1^-1\n"
+					<< "beans^5^200^0^3.5\n"
+					;
+			}
+			auto fast = load_food_catalog(path);
+			auto slow = load_food_database(path);
+			const char* snapshot_path = "maxcalorie_test_volume.bin";
+			save_food_snapshot(*fast, snapshot_path);
+			auto snapshot = load_food_snapshot(snapshot_path);
+			std::remove(path);
+			std::remove(snapshot_path);
+			TEST_TRUE("non-null", fast && slow && snapshot);
+			TEST_EQUAL("invalid row skipped", 2, fast->size());
+			TEST_EQUAL("invalid row skipped", 2, slow->size());
+			TEST_EQUAL("cost", 2.5, fast->cost(0));
+			TEST_EQUAL("volume", 3.5, fast->volume(1));
+			TEST_EQUAL("slow volume", 4, (*slow)[0]->volume());
+			TEST_EQUAL("slow cost", 0, (*slow)[1]->cost());
+			TEST_EQUAL("snapshot volume", 3.5, snapshot->volume(1));
+			TEST_EQUAL("snapshot hash", fast->content_hash(), snapshot->content_hash());
+			TEST_EQUAL("FoodVector round trip", fast->content_hash(), FoodCatalog(*slow).content_hash());
+			TEST_EQUAL("no column", 0, all_foods->front()->volume());
+
+			// Against exhaustive search on both limits.
+			FoodCatalog foods;
+			for (size_t i = 0; i < 14; i++)
+			{
+				foods.push_back("item " + std::to_string(i), 1 + (i * 7) % 11, (i % 6 == 5) ? 0 : 10 + (i * 13) % 37, 1, (i * 5) % 9, 0.5 * ((i * 3) % 7));
+			}
+			auto brute = [&](double total_weight, const double* second, double second_limit)
+			{
+				double best = 0;
+				for (uint32_t mask = 0; mask < (1u << foods.size()); mask++)
+				{
+					double weight = 0, amount = 0, calories = 0;
+					for (size_t i = 0; i < foods.size(); i++)
+					{
+						if (mask & (1u << i))
+						{
+							weight += foods.weight(i);
+							amount += second[i];
+							calories += foods.foodCalories(i);
+						}
+					}
+					if (weight <= total_weight && amount <= second_limit)
+					{
+						best = std::max(best, calories);
+					}
+				}
+				return best;
+			};
+			auto totals = [&](const FoodIndexVector& chosen, const double* second, double& weight, double& amount)
+			{
+				double calories = 0;
+				weight = amount = 0;
+				for (size_t i : chosen)
+				{
+					weight += foods.weight(i);
+					amount += second[i];
+					calories += foods.foodCalories(i);
+				}
+				return calories;
+			};
+
+			for (const double* second : {foods.volumes(), foods.costs()})
+			{
+				for (double total_weight : {0.0, 12.0, 30.0, 100.0})
+				{
+					for (double second_limit : {0.0, 6.0, 15.0, 100.0})
+					{
+						const double expected = brute(total_weight, second, second_limit);
+						double weight, amount;
+						auto exact = dynamic_max_calories_2d(foods, total_weight, second, second_limit, 1, 0.5);
+						TEST_EQUAL("exact optimum", expected, totals(*exact, second, weight, amount));
+						TEST_LE("exact weight", weight, total_weight);
+						TEST_LE("exact second", amount, second_limit);
+						TEST_TRUE("descending", std::is_sorted(exact->rbegin(), exact->rend()));
+						TEST_TRUE("selector picks exact", *exact == *max_calories_2d(foods, total_weight, second, second_limit, 1, 0.5));
+
+						double upper_bound;
+						auto heuristic = lagrangian_max_calories_2d(foods, total_weight, second, second_limit, 1, &upper_bound);
+						const double calories = totals(*heuristic, second, weight, amount);
+						TEST_LE("heuristic weight", weight, total_weight);
+						TEST_LE("heuristic second", amount, second_limit);
+						TEST_LE("heuristic not above optimum", calories, expected);
+						TEST_GE("bound above optimum", upper_bound, expected - 1e-9);
+					}
+				}
+			}
+			TEST_TRUE("negative limit", dynamic_max_calories_2d(foods, 10, foods.volumes(), -1)->empty());
+
+			// A second limit far too fine for the exact plane goes to the heuristic.
+			FoodCatalog big(*filtered_foods);
+			auto fine = max_calories_2d(big, 500, big.weights(), 300, 1, 1e-6);
+			double weight = 0;
+			for (size_t i : *fine)
+			{
+				weight += big.weight(i);
+			}
+			TEST_FALSE("heuristic result", fine->empty());
+			TEST_LE("fits the tighter limit", weight, 300);
+
+			// Two items, but a 20001 x 20001 plane of doubles: still the heuristic.
+			FoodCatalog pair;
+			pair.push_back("beans", 10, 100, 1, 5);
+			pair.push_back("rice", 20, 150, 1, 30);
+			auto wide = max_calories_2d(pair, 20000, pair.volumes(), 20000);
+			TEST_EQUAL("plane past the budget", 2, wide->size());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"streaming_max_calories", 2,
+		[&]()
+		{
+			auto catalog = load_food_catalog("food.csv");
+			// Small pieces, so lines straddle chunk boundaries, and the default.
+			for (size_t chunk_bytes : {size_t(100), FOOD_STREAM_CHUNK_BYTES})
+			{
+				for (int total_size : {50, 1000, int(catalog->size())})
+				{
+					FoodCatalog expected_foods = catalog->subset(*filter_food_catalog(*catalog, 1, 2500, total_size));
+					for (double total_weight : {500.0, 2000.0})
+					{
+						auto expected = dynamic_max_calories_rolling(expected_foods, total_weight);
+						auto soln = streaming_max_calories("food.csv", 1, 2500, total_size, total_weight, 1, chunk_bytes);
+						TEST_TRUE("non-null", soln);
+						TEST_EQUAL("same size", expected->size(), soln->size());
+						for (size_t i = 0; i < soln->size(); i++)
+						{
+							TEST_EQUAL("same description", expected_foods.description((*expected)[i]), soln->description(i));
+							TEST_EQUAL("same calories", expected_foods.foodCalories((*expected)[i]), soln->foodCalories(i));
+						}
+					}
+				}
+			}
+
+			TEST_FALSE("missing file", streaming_max_calories("no such file.csv", 1, 2500, 10, 500));
+			TEST_FALSE("invalid total size", streaming_max_calories("food.csv", 1, 2500, 0, 500));
+			TEST_TRUE("negative capacity", streaming_max_calories("food.csv", 1, 2500, 10, -1)->empty());
+
+			// A row too long to allocate throws with the parser running; the
+			// parser is joined and the exception reaches the caller.
+			bool threw = false;
+			try
+			{
+				streaming_max_calories("food.csv", 1, 2500, 10, 1e19);
+			}
+			catch (const std::length_error&)
+			{
+				threw = true;
+			}
+			TEST_TRUE("exception past the parser", threw);
+
+			const char* path = "maxcalorie_test_stream.csv";
+			{
+				std::ofstream f(path);
+				f
+					<< "Item^Weight^foodCalories\r\n"
+					<< "good beans^10^100\r\n"
+					<< "bad weight^ten^100\n"
+					<< "good rice^4^20\n"
+					<< "\n"
+					<< "after the blank line^1^1"
+					;
+			}
+			// The blank line fails the load, unless the filter is already full.
+			TEST_FALSE("invalid line", streaming_max_calories(path, 0, 1e9, 10, 100, 1, 7));
+			auto rows = streaming_max_calories(path, 0, 1e9, 2, 100, 1, 7);
+			std::remove(path);
+			TEST_TRUE("stops at total_size", rows);
+			TEST_EQUAL("both taken", 2, rows->size());
+			TEST_EQUAL("traceback order", "good rice", rows->description(0));
+			TEST_EQUAL("traceback order", "good beans", rows->description(1));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"dynamic_max_calories_batch", 2,
+		[&]()
+		{
+			std::vector<double> capacities = {14, 3, -1, 9, 10};
+			auto trivial = dynamic_max_calories_batch(trivial_foods, capacities);
+			TEST_EQUAL("one result per capacity", capacities.size(), trivial.size());
+			TEST_TRUE("negative capacity", trivial[2]->empty());
+			TEST_TRUE("nothing fits", trivial[1]->empty());
+			TEST_EQUAL("pasta only", "test pasta", (*trivial[3])[0]->description());
+			TEST_EQUAL("corn only", "test whole corn", (*trivial[4])[0]->description());
+			TEST_EQUAL("corn and pasta", 2, trivial[0]->size());
+
+			capacities = {5000, 500, 2000, 1};
+			auto batch = dynamic_max_calories_batch(*filtered_foods, capacities);
+			for (size_t k = 0; k < capacities.size(); k++)
+			{
+				auto expected = dynamic_max_calories_rolling(*filtered_foods, capacities[k]);
+				TEST_EQUAL("same size", expected->size(), batch[k]->size());
+				for (size_t i = 0; i < expected->size(); i++)
+				{
+					TEST_EQUAL("same items", (*expected)[i], (*batch[k])[i]);
+				}
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"IncrementalDynamicSolver", 2,
+		[&]()
+		{
+			auto catalog = load_food_catalog("food.csv");
+			auto indices = filter_food_catalog(*catalog, 1, 2500, 300);
+			FoodCatalog foods = catalog->subset(*indices);
+
+			IncrementalDynamicSolver solver(2000);
+			solver.add_catalog(foods);
+			TEST_EQUAL("size", 300, solver.size());
+
+			// Compare against a from-scratch solve of the same items.
+			auto check = [&](const FoodIndexVector& live)
+			{
+				FoodCatalog current = foods.subset(live);
+				for (double total_weight : {2000.0, 750.0})
+				{
+					auto expected = dynamic_max_calories_rolling(current, total_weight);
+					double expected_weight, expected_calories;
+					sum_food_catalog(current, *expected, expected_weight, expected_calories);
+
+					auto soln = solver.solve(total_weight);
+					double weight, calories;
+					sum_food_catalog(foods, *soln, weight, calories);
+					TEST_LE("fits", weight, total_weight);
+					TEST_EQUAL("same calories", std::round(expected_calories * 100), std::round(calories * 100));
+					TEST_EQUAL("best_calories", std::round(expected_calories * 100), std::round(solver.best_calories(total_weight) * 100));
+				}
+			};
+
+			FoodIndexVector live(300);
+			for (size_t i = 0; i < live.size(); i++)
+			{
+				live[i] = i;
+			}
+			check(live);
+
+			// Remove from the end, the middle and the front.
+			for (size_t id : {299, 150, 70, 0})
+			{
+				TEST_TRUE("removed", solver.remove_item(id));
+				live.erase(std::find(live.begin(), live.end(), id));
+				check(live);
+			}
+			TEST_FALSE("already removed", solver.remove_item(150));
+
+			solver.add_item(150, foods.weight(150), foods.foodCalories(150));
+			live.push_back(150);
+			check(live);
+			TEST_EQUAL("size", 297, solver.size());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"SolverCache", 2,
+		[&]()
+		{
+			auto catalog = load_food_catalog("food.csv");
+			TEST_EQUAL("same contents, same hash", catalog->content_hash(), FoodCatalog(*all_foods).content_hash());
+			FoodIndexVector first_two = {0, 1}, other_two = {0, 2};
+			TEST_NOT_EQUAL("different contents", catalog->subset(first_two).content_hash(), catalog->subset(other_two).content_hash());
+
+			SolverCache cache;
+			auto first = cache.solve(*catalog, 1, 2500, 100, 500);
+			auto again = cache.solve(*catalog, 1, 2500, 100, 500);
+			auto other = cache.solve(*catalog, 1, 2500, 100, 600);
+			TEST_TRUE("non-null", first);
+			TEST_TRUE("same shared answer", first == again);
+			TEST_FALSE("different capacity", first == other);
+			TEST_FALSE("invalid total size", cache.solve(*catalog, 1, 2500, 0, 500));
+
+			SolverCacheStats stats = cache.stats();
+			TEST_EQUAL("hits", 1, stats.hits);
+			TEST_EQUAL("misses", 3, stats.misses);
+			TEST_EQUAL("entries", 2, stats.entries);
+
+			// The answer is in catalog positions.
+			auto filtered = filter_food_vector(*all_foods, 1, 2500, 100);
+			auto expected = dynamic_max_calories_rolling(*filtered, 500);
+			TEST_EQUAL("same answer", expected->size(), first->size());
+			for (size_t i = 0; i < first->size(); i++)
+			{
+				TEST_EQUAL("same answer", (*expected)[i], (*all_foods)[(*first)[i]]);
+			}
+
+			// A cache too small for two entries keeps only the newest.
+			SolverCache tiny(SolverCache::ENTRY_OVERHEAD_BYTES + std::max(first->size(), other->size()) * sizeof(size_t));
+			tiny.solve(*catalog, 1, 2500, 100, 500);
+			tiny.solve(*catalog, 1, 2500, 100, 600);
+			tiny.solve(*catalog, 1, 2500, 100, 600);
+			stats = tiny.stats();
+			TEST_EQUAL("evicted", 1, stats.evictions);
+			TEST_EQUAL("one entry", 1, stats.entries);
+			TEST_EQUAL("newest kept", 1, stats.hits);
+		}
+	);
+
 	//
 	rubric.criterion(
 		"exhaustive_max_calories trivial cases", 2,
@@ -206,6 +1172,641 @@ int main()
 		}
 	);
 
+	//
+	rubric.criterion(
+		"exhaustive_max_calories_gray", 2,
+		[&]()
+		{
+			std::unique_ptr<FoodVector> soln;
+
+			soln = exhaustive_max_calories_gray(trivial_foods, 3);
+			TEST_TRUE("non-null", soln);
+			TEST_TRUE("empty solution", soln->empty());
+
+			soln = exhaustive_max_calories_gray(trivial_foods, 10);
+			TEST_EQUAL("whole corn only", 1, soln->size());
+			TEST_EQUAL("whole corn only", "test whole corn", (*soln)[0]->description());
+
+			soln = exhaustive_max_calories_gray(trivial_foods, 14);
+			TEST_EQUAL("whole corn and pasta", 2, soln->size());
+			TEST_EQUAL("whole corn and pasta", "test whole corn", (*soln)[0]->description());
+			TEST_EQUAL("whole corn and pasta", "test pasta", (*soln)[1]->description());
+
+			for (int n = 1; n <= 16; n++)
+			{
+				auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+				auto expected = exhaustive_max_calories(*small_foods, 2000);
+				soln = exhaustive_max_calories_gray(*small_foods, 2000);
+				TEST_TRUE("non-null", soln);
+
+				double expected_weight, expected_calories, actual_weight, actual_calories;
+				sum_food_vector(*expected, expected_weight, expected_calories);
+				sum_food_vector(*soln, actual_weight, actual_calories);
+				TEST_LE("fits", actual_weight, 2000);
+				TEST_EQUAL("same calories",
+					std::round(expected_calories * 100) / 100,
+					std::round(actual_calories * 100) / 100);
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"exhaustive_max_calories_parallel", 2,
+		[&]()
+		{
+			auto soln = exhaustive_max_calories_parallel(trivial_foods, 14, 4);
+			TEST_TRUE("non-null", soln);
+			TEST_EQUAL("whole corn and pasta", 2, soln->size());
+
+			for (int n = 1; n <= 20; n++)
+			{
+				auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+				auto expected = exhaustive_max_calories_gray(*small_foods, 2000);
+				for (unsigned threads : {1u, 3u, 8u})
+				{
+					soln = exhaustive_max_calories_parallel(*small_foods, 2000, threads);
+					TEST_TRUE("non-null", soln);
+					TEST_EQUAL("same subset as gray", expected->size(), soln->size());
+					for (size_t i = 0; i < soln->size(); i++)
+					{
+						TEST_EQUAL("same subset as gray", (*expected)[i], (*soln)[i]);
+					}
+				}
+			}
+
+			// Calories equal to weights, in whole numbers so every sum is exact:
+			// a great many subsets tie at 40, and the earliest must win however
+			// the chunks were shared out.
+			FoodCatalog ties;
+			for (int i = 0; i < 22; i++)
+			{
+				ties.push_back("tie " + std::to_string(i), 1 + i % 7, 1 + i % 7);
+			}
+			auto sequential = exhaustive_max_calories_gray(ties, 40);
+			for (unsigned threads : {1u, 2u, 5u, 16u})
+			{
+				for (int run = 0; run < 3; run++)
+				{
+					TEST_TRUE("earliest tie", *sequential == *exhaustive_max_calories_parallel(ties, 40, threads));
+				}
+			}
+
+			// Fractional sums round differently from one walk to another, but
+			// the chunks, and so the answer, are the same for any thread count.
+			FoodCatalog fractions;
+			for (int i = 0; i < 22; i++)
+			{
+				fractions.push_back("fraction " + std::to_string(i), 0.1 * (1 + i % 7), 0.3 * (1 + i % 5));
+			}
+			auto one_thread = exhaustive_max_calories_parallel(fractions, 4.0, 1);
+			TEST_TRUE("non-null", one_thread);
+			ThreadPool pool(5);
+			for (int run = 0; run < 3; run++)
+			{
+				TEST_TRUE("same for any thread count", *one_thread == *exhaustive_max_calories_parallel(fractions, 4.0, pool));
+			}
+			TEST_TRUE("same for any thread count", *one_thread == *exhaustive_max_calories_parallel(fractions, 4.0, 16));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"mitm_max_calories", 2,
+		[&]()
+		{
+			std::unique_ptr<FoodVector> soln;
+
+			soln = mitm_max_calories(trivial_foods, 3);
+			TEST_TRUE("non-null", soln);
+			TEST_TRUE("empty solution", soln->empty());
+
+			soln = mitm_max_calories(trivial_foods, 9);
+			TEST_EQUAL("pasta only", 1, soln->size());
+			TEST_EQUAL("pasta only", "test pasta", (*soln)[0]->description());
+
+			soln = mitm_max_calories(trivial_foods, 14);
+			TEST_EQUAL("whole corn and pasta", 2, soln->size());
+			TEST_EQUAL("whole corn and pasta", "test whole corn", (*soln)[0]->description());
+			TEST_EQUAL("whole corn and pasta", "test pasta", (*soln)[1]->description());
+
+			for (int n = 1; n <= 20; n++)
+			{
+				auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+				auto expected = exhaustive_max_calories_gray(*small_foods, 2000);
+				soln = mitm_max_calories(*small_foods, 2000);
+				TEST_TRUE("non-null", soln);
+
+				double expected_weight, expected_calories, actual_weight, actual_calories;
+				sum_food_vector(*expected, expected_weight, expected_calories);
+				sum_food_vector(*soln, actual_weight, actual_calories);
+				TEST_LE("fits", actual_weight, 2000);
+				TEST_EQUAL("same calories as exhaustive",
+					std::round(expected_calories * 100) / 100,
+					std::round(actual_calories * 100) / 100);
+			}
+
+			// Fractional weights, which the DP would round up.
+			FoodVector fractional;
+			fractional.push_back(std::shared_ptr<FoodItem>(new FoodItem("half can", 2.5, 10)));
+			fractional.push_back(std::shared_ptr<FoodItem>(new FoodItem("other half can", 2.5, 10)));
+			fractional.push_back(std::shared_ptr<FoodItem>(new FoodItem("brick", 5, 15)));
+			soln = mitm_max_calories(fractional, 5);
+			TEST_EQUAL("both halves", 2, soln->size());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"branch_bound_max_calories", 2,
+		[&]()
+		{
+			std::unique_ptr<FoodVector> soln;
+
+			soln = branch_bound_max_calories(trivial_foods, 3);
+			TEST_TRUE("non-null", soln);
+			TEST_TRUE("empty solution", soln->empty());
+
+			soln = branch_bound_max_calories(trivial_foods, 9);
+			TEST_EQUAL("pasta only", 1, soln->size());
+			TEST_EQUAL("pasta only", "test pasta", (*soln)[0]->description());
+
+			soln = branch_bound_max_calories(trivial_foods, 14);
+			TEST_EQUAL("whole corn and pasta", 2, soln->size());
+
+			for (double total_weight : {500.0, 5000.0})
+			{
+				BranchBoundStats stats;
+				soln = branch_bound_max_calories(*filtered_foods, total_weight, BranchBoundLimits(), &stats);
+				TEST_TRUE("non-null", soln);
+				TEST_TRUE("proven optimal", stats.optimal);
+
+				auto expected = dynamic_max_calories_rolling(*filtered_foods, total_weight);
+				double expected_weight, expected_calories, actual_weight, actual_calories;
+				sum_food_vector(*expected, expected_weight, expected_calories);
+				sum_food_vector(*soln, actual_weight, actual_calories);
+				TEST_LE("fits", actual_weight, total_weight);
+				TEST_EQUAL("same calories as dynamic",
+					std::round(expected_calories * 100) / 100,
+					std::round(actual_calories * 100) / 100);
+			}
+
+			// With a tiny node budget the search stops early, but still returns
+			// a feasible solution.
+			BranchBoundLimits limits;
+			limits.max_nodes = 100;
+			BranchBoundStats stats;
+			soln = branch_bound_max_calories(*filtered_foods, 5000, limits, &stats);
+			TEST_FALSE("not proven optimal", stats.optimal);
+			TEST_LE("node budget", stats.nodes, 100);
+			double weight, calories;
+			sum_food_vector(*soln, weight, calories);
+			TEST_LE("fits", weight, 5000);
+			TEST_GT("found something", calories, 0);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"greedy_max_calories", 2,
+		[&]()
+		{
+			std::unique_ptr<FoodVector> soln;
+			double upper_bound;
+
+			soln = greedy_max_calories(trivial_foods, 3, &upper_bound);
+			TEST_TRUE("non-null", soln);
+			TEST_TRUE("empty solution", soln->empty());
+			TEST_EQUAL("nothing fits", 0, upper_bound);
+
+			soln = greedy_max_calories(trivial_foods, 14, &upper_bound);
+			TEST_EQUAL("everything fits", 2, soln->size());
+			TEST_EQUAL("everything fits", 25, upper_bound);
+
+			// The corn can never fit, so it does not count toward the bound.
+			soln = greedy_max_calories(trivial_foods, 9, &upper_bound);
+			TEST_EQUAL("pasta only", 1, soln->size());
+			TEST_EQUAL("pasta only", "test pasta", (*soln)[0]->description());
+			TEST_EQUAL("pasta bound", 5, upper_bound);
+
+			// The candy is denser, but the sack alone is worth more.
+			FoodVector lopsided;
+			lopsided.push_back(std::shared_ptr<FoodItem>(new FoodItem("candy", 1, 2)));
+			lopsided.push_back(std::shared_ptr<FoodItem>(new FoodItem("sack of flour", 10, 10)));
+			soln = greedy_max_calories(lopsided, 10, &upper_bound);
+			TEST_EQUAL("best single item", 1, soln->size());
+			TEST_EQUAL("best single item", "sack of flour", (*soln)[0]->description());
+			TEST_EQUAL("fractional bound", 2 + 9 * 1.0, upper_bound);
+
+			FoodCatalog tenths;
+			tenths.push_back("tenth", 0.1, 1.2);
+			tenths.push_back("fifth", 0.2, 2.2);
+			tenths.push_back("three tenths", 0.3, 3.2);
+			TEST_TRUE("negative capacity", greedy_max_calories(tenths, -1.0, &upper_bound)->empty());
+			TEST_EQUAL("negative capacity bound", 0, upper_bound);
+			TEST_TRUE("empty catalog", greedy_max_calories(FoodCatalog(), 10)->empty());
+
+			// The rounded total 0.1 + 0.2 + 0.3 is above 0.6, but taken in
+			// density order each item still fits into what the ones before it
+			// left.
+			TEST_EQUAL("no critical item", 3, greedy_max_calories(tenths, 0.6, &upper_bound)->size());
+			TEST_EQUAL("no critical item bound", 1.2 + 2.2 + 3.2, upper_bound);
+
+			for (double total_weight : {500.0, 5000.0})
+			{
+				soln = greedy_max_calories(*filtered_foods, total_weight, &upper_bound);
+				auto optimal = branch_bound_max_calories(*filtered_foods, total_weight);
+
+				double weight, calories, optimal_weight, optimal_calories;
+				sum_food_vector(*soln, weight, calories);
+				sum_food_vector(*optimal, optimal_weight, optimal_calories);
+				TEST_LE("fits", weight, total_weight);
+				TEST_LE("not above optimum", calories, optimal_calories + 1e-6);
+				TEST_GE("bound above optimum", upper_bound, optimal_calories - 1e-6);
+				TEST_GE("at least half", calories, optimal_calories / 2);
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"SolveService", 2,
+		[&]()
+		{
+			// Tasks submitted from tasks run too, and the destructor waits.
+			std::atomic<int> ran{0};
+			{
+				WorkStealingPool pool(3);
+				for (int k = 0; k < 100; k++)
+				{
+					pool.submit([&]()
+					{
+						ran++;
+						pool.submit([&]() { ran++; });
+					});
+				}
+			}
+			TEST_EQUAL("every task ran", 200, ran.load());
+
+			TEST_EQUAL("tiny n", "exhaustive", std::string(choose_solver(8, 5000, 1, INFINITY)));
+			TEST_EQUAL("small n, small W", "dynamic", std::string(choose_solver(36, 1e6, 1, INFINITY)));
+			TEST_EQUAL("small n, large W", "mitm", std::string(choose_solver(36, 1e7, 1, INFINITY)));
+			TEST_EQUAL("large n", "dynamic", std::string(choose_solver(1000, 500, 1, INFINITY)));
+			TEST_EQUAL("DP too big", "branch_bound", std::string(choose_solver(1000, 1e12, 1, INFINITY)));
+			TEST_EQUAL("DP too slow", "branch_bound", std::string(choose_solver(1000, 500, 1, 3e-4)));
+			TEST_EQUAL("no time", "greedy", std::string(choose_solver(1000, 500, 1, 1e-7)));
+			TEST_EQUAL("mitm fits", "mitm", std::string(choose_solver(44, 1e12, 1, INFINITY)));
+			TEST_EQUAL("mitm too big, exhaustive too slow", "branch_bound", std::string(choose_solver(60, 1e12, 1, INFINITY)));
+
+			std::shared_ptr<const FoodCatalog> catalog(load_food_catalog("food.csv").release());
+			SolveService service(2);
+			std::vector<SolveRequest> requests;
+			for (int total_size : {12, 30, 200, 2000})
+			{
+				for (double total_weight : {100.0, 1000.0})
+				{
+					SolveRequest request;
+					request.catalog = catalog;
+					request.min_calories = 1;
+					request.max_calories = 2500;
+					request.total_size = total_size;
+					request.total_weight = total_weight;
+					requests.push_back(request);
+				}
+			}
+			SolveRequest late = requests.back();
+			late.deadline = std::chrono::steady_clock::now();
+			requests.push_back(late);
+			SolveRequest invalid = requests.front();
+			invalid.total_size = 0;
+			requests.push_back(invalid);
+
+			std::vector<std::future<SolveResult>> futures;
+			for (const SolveRequest& request : requests)
+			{
+				futures.push_back(service.submit(request));
+			}
+			for (size_t k = 0; k < requests.size(); k++)
+			{
+				SolveResult result = futures[k].get();
+				const SolveRequest& request = requests[k];
+				if (request.total_size <= 0)
+				{
+					TEST_FALSE("invalid total size", result.best);
+					continue;
+				}
+				TEST_TRUE("non-null", result.best);
+				TEST_TRUE("ascending", std::is_sorted(result.best->begin(), result.best->end()));
+
+				double weight, calories;
+				sum_food_catalog(*catalog, *result.best, weight, calories);
+				TEST_LE("fits", weight, request.total_weight);
+				TEST_TRUE("calories", std::abs(calories - result.calories) < 1e-6);
+
+				FoodCatalog foods = catalog->subset(*filter_food_catalog(*catalog, 1, 2500, request.total_size));
+				double optimal_weight, optimal_calories;
+				sum_food_catalog(foods, *branch_bound_max_calories(foods, request.total_weight), optimal_weight, optimal_calories);
+				TEST_LE("not above optimum", calories, optimal_calories + 1e-6);
+				if (k + 2 < requests.size())
+				{
+					TEST_TRUE("optimal", result.optimal);
+					TEST_GE("optimum", calories, optimal_calories - 1e-6);
+				}
+				else
+				{
+					TEST_TRUE("past the deadline", std::string(result.solver) == "greedy" || std::string(result.solver) == "branch_bound");
+				}
+			}
+
+			// A job that throws fails its own future, not the service.
+			SolveService failing(2, [](const SolveRequest& request) -> SolveResult
+			{
+				if (request.total_size == 13)
+				{
+					throw std::bad_alloc();
+				}
+				return solve_request(request);
+			});
+			SolveRequest unlucky = requests.front();
+			unlucky.total_size = 13;
+			std::future<SolveResult> failed = failing.submit(unlucky);
+			std::future<SolveResult> fine = failing.submit(requests.front());
+			bool threw = false;
+			try
+			{
+				failed.get();
+			}
+			catch (const std::bad_alloc&)
+			{
+				threw = true;
+			}
+			TEST_TRUE("failure in the future", threw);
+			TEST_TRUE("other jobs unaffected", fine.get().best);
+
+			// Exact solvers given a deadline that has passed give up, leaving
+			// the greedy answer.
+			const SolverDeadline past = std::chrono::steady_clock::now();
+			FoodCatalog first = catalog->subset(*filter_food_catalog(*catalog, 1, 2500, 20));
+			FoodIndexVector none;
+			TEST_FALSE("gray deadline", exhaustive_max_calories_gray(first, 500, none, past));
+			TEST_TRUE("gray deadline", none.empty());
+			TEST_FALSE("mitm deadline", mitm_max_calories(first, 500, past));
+			SolverWorkspace workspace;
+			TEST_FALSE("dynamic deadline", dynamic_max_calories_rolling(first, 500, workspace, none, 1, past));
+			TEST_TRUE("no deadline", dynamic_max_calories_rolling(first, 500, workspace, none));
+
+			SolveRequest timed = requests.front();
+			timed.total_size = 20;
+			timed.total_weight = 500;
+			const SolveResult untimed = solve_request(timed);
+			TEST_TRUE("greedy not optimal here", std::string(untimed.solver) != "greedy");
+			for (const char* solver : {"exhaustive", "mitm", "dynamic", "branch_bound"})
+			{
+				timed.solver = solver;
+				timed.deadline = past;
+				SolveResult result = service.submit(timed).get();
+				// Branch and bound keeps what it found before its first check.
+				TEST_TRUE("fallback", std::string(result.solver) == "greedy" || std::string(solver) == "branch_bound");
+				TEST_FALSE("fallback not optimal", result.optimal);
+				TEST_LE("fallback below optimum", result.calories, untimed.calories);
+				timed.deadline = NO_SOLVER_DEADLINE;
+				TEST_EQUAL("forced solver", solver, std::string(service.submit(timed).get().solver));
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"solver instrumentation", 2,
+		[&]()
+		{
+			SolverStats& stats = solver_stats();
+			stats.reset();
+
+			auto catalog = load_food_catalog("food.csv");
+			auto indices = filter_food_catalog(*catalog, 1, 2500, 100);
+			FoodCatalog foods = catalog->subset(*indices);
+			FoodCatalog small = foods.subset(FoodIndexVector({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+
+			dynamic_max_calories_rolling(foods, 500);
+			exhaustive_max_calories_gray(small, 100);
+			BranchBoundStats bb;
+			branch_bound_max_calories(foods, 500, BranchBoundLimits(), &bb);
+
+#ifdef MAXCALORIE_STATS
+			// Row i only covers the columns up to its prefix weight.
+			uint64_t cells = 0, limit = 1;
+			for (size_t w : dp_weight_units(foods, 1))
+			{
+				limit = std::min<uint64_t>(501, limit + w);
+				cells += limit;
+			}
+			TEST_EQUAL("dp cells", cells, stats.dp_cells.load());
+			TEST_LT("fewer than the full table", cells, 100 * 501);
+			TEST_EQUAL("subsets", 1024, stats.subsets.load());
+			TEST_EQUAL("nodes", bb.nodes, stats.branch_bound_nodes.load());
+			TEST_EQUAL("pruned", bb.pruned, stats.branch_bound_pruned.load());
+			TEST_GE("allocated", stats.bytes_allocated.load(), 501 * sizeof(double));
+			TEST_GT("load time", stats.load_nanoseconds.load(), 0);
+			TEST_GT("traceback time", stats.traceback_nanoseconds.load(), 0);
+
+			// A warm workspace does not allocate again.
+			SolverWorkspace workspace;
+			FoodIndexVector best;
+			dynamic_max_calories_rolling(foods, 500, workspace, best);
+			const uint64_t allocated = stats.bytes_allocated.load();
+			dynamic_max_calories_rolling(foods, 500, workspace, best);
+			TEST_EQUAL("no growth", allocated, stats.bytes_allocated.load());
+#else
+			// Compiled out: the counters are never touched.
+			TEST_EQUAL("dp cells", 0, stats.dp_cells.load());
+			TEST_EQUAL("subsets", 0, stats.subsets.load());
+			TEST_EQUAL("load time", 0, stats.load_nanoseconds.load());
+#endif
+			stats.reset();
+			TEST_EQUAL("reset", 0, stats.dp_cells.load());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"timers and profile regions", 2,
+		[&]()
+		{
+			Timer timer;
+			CycleTimer cycles;
+			TEST_GT("per tick", cycle_counter_seconds_per_tick(), 0);
+			volatile double sink = 0;
+			for (int k = 0; k < 1000000; k++)
+			{
+				sink = sink + k;
+			}
+			const double seconds = timer.elapsed(), cycle_seconds = cycles.elapsed();
+			TEST_GT("timer", seconds, 0);
+			TEST_GT("cycle ticks", cycles.ticks(), 0);
+			// The two clocks agree to within a factor of two.
+			TEST_TRUE("clocks agree", cycle_seconds < 2 * seconds && seconds < 2 * cycle_seconds);
+
+			static ProfileRegion region("test region");
+			region.reset();
+			for (int k = 0; k < 10; k++)
+			{
+				ProfileScope scope(region);
+			}
+			region.record(0);
+			TEST_EQUAL("passes", 11, region.count());
+			uint64_t binned = 0;
+			for (int b = 0; b < ProfileRegion::BINS; b++)
+			{
+				binned += region.bin(b);
+			}
+			TEST_EQUAL("binned", 11, binned);
+			TEST_GE("zero in bin 0", region.bin(0), 1);
+			TEST_GE("p99 at least p50", region.percentile_nanoseconds(0.99), region.percentile_nanoseconds(0.5));
+
+			std::ostringstream report;
+			print_profile_report(report);
+			TEST_TRUE("reported", report.str().find("test region: 11 passes") != std::string::npos);
+			reset_profile();
+			TEST_EQUAL("reset", 0, region.count());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"benchmark harness", 2,
+		[&]()
+		{
+			std::vector<double> sorted = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+			TEST_EQUAL("p50", 5, benchmark_percentile(sorted, 0.5));
+			TEST_EQUAL("p99", 10, benchmark_percentile(sorted, 0.99));
+			TEST_EQUAL("p10", 1, benchmark_percentile(sorted, 0.1));
+
+			int calls = 0;
+			BenchmarkOptions options;
+			options.warmup = 2;
+			options.repeats = 7;
+			options.max_seconds = 1e9;
+			BenchmarkResult result = run_benchmark("counter", "none", 1, 0, [&]() { return double(++calls); }, options);
+			TEST_EQUAL("warm-up and repeats", 9, calls);
+			TEST_EQUAL("repeats", 7, result.repeats);
+			TEST_EQUAL("last value", 9, result.value);
+			TEST_TRUE("ordered", result.min_seconds <= result.median_seconds && result.median_seconds <= result.p99_seconds);
+
+			// A zero time budget stops at min_repeats.
+			options.max_seconds = 0;
+			TEST_EQUAL("time budget", options.min_repeats, run_benchmark("counter", "none", 1, 0, [&]() { return 0.0; }, options).repeats);
+
+			FoodCatalog uniform = make_benchmark_catalog("uniform", 50);
+			TEST_EQUAL("synthetic size", 50, uniform.size());
+			TEST_EQUAL("deterministic", uniform.content_hash(), make_benchmark_catalog("uniform", 50).content_hash());
+			TEST_TRUE("unknown distribution", make_benchmark_catalog("nonsense", 50).empty());
+
+			const char* path = "maxcalorie_test_benchmark.csv";
+			{
+				std::ofstream f(path);
+				write_benchmark_csv(f, {result});
+			}
+			std::vector<BenchmarkResult> baseline;
+			TEST_TRUE("read back", read_benchmark_csv(path, baseline));
+			std::remove(path);
+			TEST_EQUAL("one row", 1, baseline.size());
+			TEST_EQUAL("solver", "counter", baseline[0].solver);
+			TEST_EQUAL("repeats", 7, baseline[0].repeats);
+
+			BenchmarkResult slower = baseline[0];
+			slower.median_seconds = baseline[0].median_seconds * 2 + 1e-3;
+			TEST_EQUAL("regression", 1, compare_benchmarks(baseline, {slower}, 0.1).size());
+			TEST_TRUE("no regression", compare_benchmarks(baseline, baseline, 0.1).empty());
+			slower.solver = "other";
+			TEST_TRUE("unmatched case", compare_benchmarks(baseline, {slower}, 0.1).empty());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"parallel loader and filter", 2,
+		[&]()
+		{
+			auto catalog = load_food_catalog("food.csv");
+			for (unsigned threads : {1u, 4u, 7u})
+			{
+				ThreadPool pool(threads);
+				auto parallel = load_food_catalog_parallel("food.csv", pool);
+				TEST_TRUE("loaded", parallel);
+				TEST_EQUAL("size", catalog->size(), parallel->size());
+				TEST_EQUAL("content hash", catalog->content_hash(), parallel->content_hash());
+				bool same = true;
+				for (size_t i = 0; i < catalog->size(); i++)
+				{
+					same = same && catalog->description(i) == parallel->description(i)
+						&& catalog->weight(i) == parallel->weight(i)
+						&& catalog->foodCalories(i) == parallel->foodCalories(i);
+				}
+				TEST_TRUE("same items", same);
+
+				for (int total_size : {1, 10, 100, int(catalog->size()), int(catalog->size()) + 5})
+				{
+					FoodIndexVector filtered;
+					TEST_TRUE("filtered", filter_food_catalog_parallel(*catalog, 1, 2500, total_size, pool, filtered));
+					TEST_TRUE("same filter", filtered == *filter_food_catalog(*catalog, 1, 2500, total_size));
+				}
+				FoodIndexVector filtered;
+				TEST_FALSE("invalid total size", filter_food_catalog_parallel(*catalog, 1, 2500, 0, pool, filtered));
+			}
+
+			// Appending the halves of a catalog gives the hash of the whole.
+			FoodIndexVector front, back;
+			for (size_t i = 0; i < catalog->size(); i++)
+			{
+				(i < catalog->size() / 3 ? front : back).push_back(i);
+			}
+			FoodCatalog joined = catalog->subset(front);
+			joined.append(catalog->subset(back));
+			TEST_EQUAL("appended size", catalog->size(), joined.size());
+			TEST_EQUAL("appended hash", catalog->content_hash(), joined.content_hash());
+			TEST_EQUAL("appended description", catalog->description(catalog->size() - 1), joined.description(catalog->size() - 1));
+
+			ThreadPool pool(4);
+			TEST_FALSE("missing file", load_food_catalog_parallel("no such file.csv", pool));
+			const char* path = "maxcalorie_test_parallel.csv";
+			{
+				std::ofstream f(path);
+				f
+					<< "Item^Weight^foodCalories^Quantity\r\n"
+					<< "beans^10^100^2\r\n"
+					<< "rice^4^20^1\n"
+					<< "corn^3^30^5"
+					;
+			}
+			auto rows = load_food_catalog_parallel(path, pool);
+			TEST_TRUE("short file", rows);
+			TEST_EQUAL("short file size", 3, rows->size());
+			TEST_EQUAL("no trailing newline", "corn", rows->description(2));
+			TEST_EQUAL("quantity column", 5, rows->quantity(2));
+			TEST_EQUAL("short file hash", load_food_catalog(path)->content_hash(), rows->content_hash());
+			{
+				std::ofstream f(path);
+				f << "Item^Weight^foodCalories\n";
+				for (int k = 0; k < 100; k++)
+				{
+					f << "row " << k << "^1^" << (k == 33 ? "many" : "1") << (k == 77 ? "^1" : "") << "\n";
+				}
+			}
+			TEST_FALSE("invalid line", load_food_catalog_parallel(path, pool));
+			{
+				std::ofstream f(path);
+				f << "Item^Weight^foodCalories\n";
+				for (int k = 0; k < 100; k++)
+				{
+					f << "row " << k << "^1^" << (k == 33 ? "many" : "1") << "\n";
+				}
+			}
+			TEST_EQUAL("unreadable number skipped", 99, load_food_catalog_parallel(path, pool)->size());
+			std::remove(path);
+		}
+	);
+
 	return rubric.run();
 }
 
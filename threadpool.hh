@@ -0,0 +1,413 @@
+///////////////////////////////////////////////////////////////////////////////
+// threadpool.hh
+//
+// Persistent worker threads for the parallel solvers in maxcalorie.hh.
+//
+// A ThreadPool starts its threads once and reuses them for every run(), so
+// a solver that needs a fork and join per DP row does not pay for thread
+// creation each time. SpinBarrier lets the threads of one run() step
+// through a sequence of phases together. BoundedQueue hands work from a
+// producer thread to a consumer, as in the streaming solver.
+// WorkStealingPool runs independent tasks, such as the jobs of a
+// SolveService, on a shared set of threads.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// Number of worker threads to use for a requested thread_count, where 0
+// means one per hardware thread.
+inline unsigned solver_thread_count(unsigned thread_count)
+{
+	if (thread_count == 0)
+	{
+		thread_count = std::thread::hardware_concurrency();
+	}
+	return std::max(thread_count, 1u);
+}
+
+
+// A reusable barrier for a fixed number of threads.
+// Waiting threads spin briefly before yielding, since the parallel DP
+// reaches the barrier once per item and the phases are short.
+class SpinBarrier
+{
+	//
+	public:
+
+		//
+		explicit SpinBarrier(unsigned count)
+			:
+			_count(count),
+			_waiting(0),
+			_generation(0)
+		{
+			assert(count > 0);
+		}
+
+		// Block until all count threads have called wait().
+		void wait()
+		{
+			const unsigned generation = _generation.load(std::memory_order_acquire);
+			if (_waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == _count)
+			{
+				_waiting.store(0, std::memory_order_relaxed);
+				_generation.fetch_add(1, std::memory_order_release);
+				return;
+			}
+
+			for (unsigned spins = 0; _generation.load(std::memory_order_acquire) == generation; spins++)
+			{
+				if (spins >= 1024)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	//
+	private:
+
+		const unsigned _count;
+		std::atomic<unsigned> _waiting;
+		std::atomic<unsigned> _generation;
+};
+
+
+// A fixed set of threads that together run one task at a time.
+class ThreadPool
+{
+	//
+	public:
+
+		// Start a pool of thread_count threads (0 means one per hardware
+		// thread), counting the thread that calls run().
+		explicit ThreadPool(unsigned thread_count = 0)
+		{
+			const unsigned threads = solver_thread_count(thread_count);
+			for (unsigned t = 1; t < threads; t++)
+			{
+				_workers.emplace_back([this, t]() { worker_loop(t); });
+			}
+		}
+
+		//
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopping = true;
+			}
+			_wake.notify_all();
+			for (auto& worker : _workers)
+			{
+				worker.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Number of threads, including the caller of run().
+		unsigned size() const { return _workers.size() + 1; }
+
+		// Call task(t) once for every t in [0, size()), each on its own thread,
+		// and return when all of them have finished. The calling thread runs
+		// task(0). Concurrent calls are run one after the other.
+		void run(const std::function<void(unsigned)>& task)
+		{
+			std::lock_guard<std::mutex> one_at_a_time(_run_mutex);
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_task = &task;
+				_pending = _workers.size();
+				_generation++;
+			}
+			_wake.notify_all();
+
+			task(0);
+
+			std::unique_lock<std::mutex> lock(_mutex);
+			_done.wait(lock, [this]() { return _pending == 0; });
+			_task = nullptr;
+		}
+
+	//
+	private:
+
+		// Body of worker thread t: run each new task, until the pool stops.
+		void worker_loop(unsigned t)
+		{
+			uint64_t seen = 0;
+			for (;;)
+			{
+				const std::function<void(unsigned)>* task;
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [&]() { return _stopping || _generation != seen; });
+					if (_stopping)
+					{
+						return;
+					}
+					seen = _generation;
+					task = _task;
+				}
+
+				(*task)(t);
+
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (--_pending == 0)
+				{
+					_done.notify_one();
+				}
+			}
+		}
+
+		std::vector<std::thread> _workers;
+
+		// Guards everything below; _run_mutex serializes run() calls.
+		std::mutex _mutex, _run_mutex;
+		std::condition_variable _wake, _done;
+		const std::function<void(unsigned)>* _task = nullptr;
+		uint64_t _generation = 0;
+		size_t _pending = 0;
+		bool _stopping = false;
+};
+
+
+// A blocking first-in first-out queue holding at most a fixed number of
+// values, for a producer that should not get far ahead of its consumer.
+// Either side may close() it: a producer when it has no more values, a
+// consumer when it wants no more.
+template <typename Value>
+class BoundedQueue
+{
+	//
+	public:
+
+		//
+		explicit BoundedQueue(size_t capacity)
+			:
+			_capacity(capacity)
+		{
+			assert(capacity > 0);
+		}
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		// Add a value, waiting while the queue is full. Returns false, dropping
+		// the value, once the queue is closed.
+		bool push(Value&& value)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_not_full.wait(lock, [this]() { return _closed || _values.size() < _capacity; });
+			if (_closed)
+			{
+				return false;
+			}
+			_values.push_back(std::move(value));
+			lock.unlock();
+			_not_empty.notify_one();
+			return true;
+		}
+
+		// Take the oldest value, waiting while the queue is empty. Returns
+		// false once the queue is closed and empty.
+		bool pop(Value& value)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_not_empty.wait(lock, [this]() { return _closed || !_values.empty(); });
+			if (_values.empty())
+			{
+				return false;
+			}
+			value = std::move(_values.front());
+			_values.pop_front();
+			lock.unlock();
+			_not_full.notify_one();
+			return true;
+		}
+
+		// Refuse further pushes and wake every waiting thread. Values already
+		// queued can still be popped.
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_closed = true;
+			}
+			_not_full.notify_all();
+			_not_empty.notify_all();
+		}
+
+	//
+	private:
+
+		const size_t _capacity;
+		std::mutex _mutex;
+		std::condition_variable _not_full, _not_empty;
+		std::deque<Value> _values;
+		bool _closed = false;
+};
+
+// A fixed set of threads running independently submitted tasks.
+// Each thread has its own deque of tasks. A task submitted from one of the
+// pool's threads goes on that thread's deque, and anything else is dealt out
+// round robin. A thread runs its own newest task first and, when its deque is
+// empty, steals the oldest task of another thread, so a burst submitted to
+// one thread spreads over all of them. The destructor runs every task still
+// queued before joining the threads.
+class WorkStealingPool
+{
+	//
+	public:
+
+		// Start thread_count threads (0 means one per hardware thread).
+		explicit WorkStealingPool(unsigned thread_count = 0)
+		{
+			const unsigned threads = solver_thread_count(thread_count);
+			for (unsigned t = 0; t < threads; t++)
+			{
+				_deques.emplace_back(new TaskDeque);
+			}
+			for (unsigned t = 0; t < threads; t++)
+			{
+				_threads.emplace_back([this, t]() { worker_loop(t); });
+			}
+		}
+
+		//
+		~WorkStealingPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopping = true;
+			}
+			_wake.notify_all();
+			for (auto& thread : _threads)
+			{
+				thread.join();
+			}
+		}
+
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+		//
+		unsigned size() const { return _deques.size(); }
+
+		// Queue task to run on one of the threads.
+		void submit(std::function<void()> task)
+		{
+			const unsigned t = current_pool() == this
+				? current_thread()
+				: _next.fetch_add(1, std::memory_order_relaxed) % size();
+			{
+				std::lock_guard<std::mutex> lock(_deques[t]->mutex);
+				_deques[t]->tasks.push_back(std::move(task));
+			}
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_queued++;
+			}
+			_wake.notify_one();
+		}
+
+	//
+	private:
+
+		struct TaskDeque
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		// The pool, and the thread of it, that the calling thread belongs to.
+		static const WorkStealingPool*& current_pool()
+		{
+			static thread_local const WorkStealingPool* pool = nullptr;
+			return pool;
+		}
+		static unsigned& current_thread()
+		{
+			static thread_local unsigned thread = 0;
+			return thread;
+		}
+
+		// Take the newest task of deque t, or else the oldest of another one.
+		bool take(unsigned t, std::function<void()>& task)
+		{
+			for (unsigned k = 0; k < size(); k++)
+			{
+				TaskDeque& deque = *_deques[(t + k) % size()];
+				std::lock_guard<std::mutex> lock(deque.mutex);
+				if (!deque.tasks.empty())
+				{
+					if (k == 0)
+					{
+						task = std::move(deque.tasks.back());
+						deque.tasks.pop_back();
+					}
+					else
+					{
+						task = std::move(deque.tasks.front());
+						deque.tasks.pop_front();
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Body of thread t. A thread first claims one of the _queued tasks, so
+		// it knows there is a task for it in some deque, and then finds it.
+		void worker_loop(unsigned t)
+		{
+			current_pool() = this;
+			current_thread() = t;
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [this]() { return _stopping || _queued > 0; });
+					if (_queued == 0)
+					{
+						return;
+					}
+					_queued--;
+				}
+
+				std::function<void()> task;
+				while (!take(t, task))
+				{
+					std::this_thread::yield();
+				}
+				task();
+			}
+		}
+
+		std::vector<std::unique_ptr<TaskDeque>> _deques;
+		std::vector<std::thread> _threads;
+		std::atomic<unsigned> _next{0};
+
+		// Guards _queued, the number of tasks not yet claimed, and _stopping.
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		size_t _queued = 0;
+		bool _stopping = false;
+};
@@ -3,10 +3,11 @@
 //
 // Timer class for code timing.
 //
-// This class depends only on the C++11 STL so it ought to be
-// portable. It uses the std::clock() function which is precise to
-// platform-dependent fractions of a second, as specified by
-// CLOCKS_PER_SEC.
+// Timer uses std::chrono::steady_clock, which never goes backwards, so it
+// is portable and safe to use across clock adjustments. CycleTimer reads
+// the CPU's cycle counter instead (rdtsc on x86, cntvct on ARM64), which is
+// cheaper to read and finer-grained, for timing very short code.
+// PROFILE_SCOPE regions build on it; see the end of the file.
 //
 // How to use:
 //
@@ -20,8 +21,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 class Timer {
  /*
@@ -36,18 +45,293 @@ public:
 
  // Reset the timer.
  void reset() {
-  _start = std::chrono::high_resolution_clock::now();
+  _start = std::chrono::steady_clock::now();
  }
 
  // Return the number of seconds since the timer was created, or the
  // last time it was reset.
  double elapsed() const {
-  auto end = std::chrono::high_resolution_clock::now();
-  assert(end >= _start);
+  auto end = std::chrono::steady_clock::now();
   auto time_span = std::chrono::duration_cast<std::chrono::duration<double>>(end - _start);
   return time_span.count();
  }
 
  private:
- std::chrono::high_resolution_clock::time_point _start;
+ std::chrono::steady_clock::time_point _start;
+};
+
+// Read the CPU's cycle counter: the time-stamp counter on x86, the virtual
+// counter on ARM64, and steady_clock nanoseconds anywhere else. Only the
+// difference of two readings on the same machine means anything. On x86 this
+// assumes an invariant TSC, which every x86 CPU of the last decade has.
+inline uint64_t cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+ return __rdtsc();
+#elif defined(__aarch64__)
+ uint64_t value;
+ asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+ return value;
+#else
+ return std::chrono::duration_cast<std::chrono::nanoseconds>(
+  std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Seconds per cycle_counter tick. On x86 it is measured once, against
+// steady_clock over 10 ms, the first time it is called; call it during
+// startup to keep that out of any measurement. ARM64 reports its counter
+// frequency directly.
+inline double cycle_counter_seconds_per_tick() {
+ static const double seconds = []() {
+#if defined(__x86_64__) || defined(__i386__)
+  auto start = std::chrono::steady_clock::now();
+  uint64_t first = cycle_counter();
+  std::chrono::duration<double> elapsed;
+  do {
+   elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed.count() < 0.01);
+  uint64_t ticks = cycle_counter() - first;
+  return ticks > 0 ? elapsed.count() / ticks : 1e-9;
+#elif defined(__aarch64__)
+  uint64_t frequency;
+  asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+  return 1.0 / frequency;
+#else
+  return 1e-9;
+#endif
+ }();
+ return seconds;
+}
+
+// Same interface as Timer, on the cycle counter.
+class CycleTimer {
+public:
+ CycleTimer() {
+  reset();
+ }
+
+ void reset() {
+  _start = cycle_counter();
+ }
+
+ // Counter ticks since the timer was created or reset.
+ uint64_t ticks() const {
+  return cycle_counter() - _start;
+ }
+
+ double elapsed() const {
+  return ticks() * cycle_counter_seconds_per_tick();
+ }
+
+ private:
+ uint64_t _start;
 };
+
+// Counters of where the solvers and loaders in maxcalorie.hh spend their
+// work, for builds with -DMAXCALORIE_STATS. Without it the
+// MAXCALORIE_STATS_* macros below expand to nothing, so the counters cost
+// nothing and stay zero. Updates are relaxed atomic adds, made once per DP
+// row, per solve or per load rather than per cell, so the parallel solvers
+// can share them.
+struct SolverStats {
+ std::atomic<uint64_t> dp_cells{0};              // DP cells evaluated
+ std::atomic<uint64_t> subsets{0};               // subsets enumerated by the exhaustive and MITM searches
+ std::atomic<uint64_t> branch_bound_nodes{0};    // branch-and-bound nodes visited
+ std::atomic<uint64_t> branch_bound_pruned{0};   // ... and pruned by the bound
+ std::atomic<uint64_t> bytes_allocated{0};       // growth of solver scratch buffers (DP tables, rows, bitsets)
+ std::atomic<uint64_t> load_nanoseconds{0};      // loading and parsing the food database and snapshots
+ std::atomic<uint64_t> traceback_nanoseconds{0}; // DP tracebacks
+
+ // Zero every counter.
+ void reset() {
+  dp_cells = 0;
+  subsets = 0;
+  branch_bound_nodes = 0;
+  branch_bound_pruned = 0;
+  bytes_allocated = 0;
+  load_nanoseconds = 0;
+  traceback_nanoseconds = 0;
+ }
+};
+
+// The process-wide counters.
+inline SolverStats& solver_stats() {
+ static SolverStats stats;
+ return stats;
+}
+
+// Adds the nanoseconds of its lifetime to a counter.
+class StatsScopeTimer {
+public:
+ explicit StatsScopeTimer(std::atomic<uint64_t>& counter)
+  : _counter(counter), _start(std::chrono::steady_clock::now()) {
+ }
+
+ ~StatsScopeTimer() {
+  auto elapsed = std::chrono::steady_clock::now() - _start;
+  _counter.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+ }
+
+ StatsScopeTimer(const StatsScopeTimer&) = delete;
+ StatsScopeTimer& operator=(const StatsScopeTimer&) = delete;
+
+ private:
+ std::atomic<uint64_t>& _counter;
+ std::chrono::steady_clock::time_point _start;
+};
+
+#define MAXCALORIE_STATS_CONCAT_(a, b) a##b
+#define MAXCALORIE_STATS_CONCAT(a, b) MAXCALORIE_STATS_CONCAT_(a, b)
+
+// MAXCALORIE_STATS_ADD(counter, amount) adds amount to the named counter;
+// MAXCALORIE_STATS_SCOPE(counter) times the rest of the enclosing block into
+// it. Disabled, neither evaluates its arguments.
+#ifdef MAXCALORIE_STATS
+#define MAXCALORIE_STATS_ADD(counter, amount) \
+ solver_stats().counter.fetch_add(uint64_t(amount), std::memory_order_relaxed)
+#define MAXCALORIE_STATS_SCOPE(counter) \
+ StatsScopeTimer MAXCALORIE_STATS_CONCAT(stats_scope_, __LINE__)(solver_stats().counter)
+#else
+#define MAXCALORIE_STATS_ADD(counter, amount) ((void)0)
+#define MAXCALORIE_STATS_SCOPE(counter) ((void)0)
+#endif
+
+// Scoped profiling regions, for builds with -DMAXCALORIE_PROFILE.
+//
+//  {
+//   PROFILE_SCOPE("batch: DP fill");
+//   ... code to profile ...
+//  }
+//  print_profile_report(std::cout);
+//
+// Each label gets one ProfileRegion (a function-local static, so the label
+// must be a string literal), which counts the times through the scope, their
+// total, and a histogram of their durations in power-of-two nanosecond bins.
+// Recording is a cycle counter read at each end of the scope plus a few
+// relaxed atomic adds; nothing is allocated, regions are listed in a fixed
+// table, and any thread may record. Without MAXCALORIE_PROFILE,
+// PROFILE_SCOPE expands to nothing.
+class ProfileRegion {
+public:
+ static const int BINS = 48;       // bin b holds durations in [2^(b-1), 2^b) ns; bin 0 is under 1 ns
+ static const int MAX_REGIONS = 64; // regions past this still record, but are not reported
+
+ explicit ProfileRegion(const char* label)
+  : _label(label) {
+  cycle_counter_seconds_per_tick();
+  size_t slot = table_size().fetch_add(1);
+  if (slot < MAX_REGIONS) {
+   table()[slot] = this;
+  }
+ }
+
+ ProfileRegion(const ProfileRegion&) = delete;
+ ProfileRegion& operator=(const ProfileRegion&) = delete;
+
+ // Add one pass through the region, of the given number of counter ticks.
+ void record(uint64_t ticks) {
+  uint64_t nanoseconds = uint64_t(ticks * cycle_counter_seconds_per_tick() * 1e9);
+  int bin = 0;
+  while (bin < BINS - 1 && (uint64_t(1) << bin) <= nanoseconds) {
+   bin++;
+  }
+  _count.fetch_add(1, std::memory_order_relaxed);
+  _nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+  _bins[bin].fetch_add(1, std::memory_order_relaxed);
+ }
+
+ const char* label() const { return _label; }
+ uint64_t count() const { return _count.load(); }
+ uint64_t total_nanoseconds() const { return _nanoseconds.load(); }
+ uint64_t bin(int b) const { return _bins[b].load(); }
+
+ // Upper edge, in nanoseconds, of the bin holding the given fraction of the
+ // passes (0.5 for the median); 0 if there are none.
+ uint64_t percentile_nanoseconds(double fraction) const {
+  uint64_t total = count(), seen = 0;
+  for (int b = 0; b < BINS; b++) {
+   seen += bin(b);
+   if (total > 0 && seen >= fraction * total) {
+    return uint64_t(1) << b;
+   }
+  }
+  return 0;
+ }
+
+ void reset() {
+  _count = 0;
+  _nanoseconds = 0;
+  for (auto& b : _bins) {
+   b = 0;
+  }
+ }
+
+ // The regions created so far, and how many there are.
+ static ProfileRegion* const* regions() { return table(); }
+ static size_t region_count() { return std::min<size_t>(table_size().load(), MAX_REGIONS); }
+
+ private:
+ static ProfileRegion** table() {
+  static ProfileRegion* regions[MAX_REGIONS];
+  return regions;
+ }
+ static std::atomic<size_t>& table_size() {
+  static std::atomic<size_t> size{0};
+  return size;
+ }
+
+ const char* _label;
+ std::atomic<uint64_t> _count{0};
+ std::atomic<uint64_t> _nanoseconds{0};
+ std::atomic<uint64_t> _bins[BINS] = {};
+};
+
+// Records the cycle-counter time of its lifetime into a region.
+class ProfileScope {
+public:
+ explicit ProfileScope(ProfileRegion& region)
+  : _region(region), _start(cycle_counter()) {
+ }
+
+ ~ProfileScope() {
+  _region.record(cycle_counter() - _start);
+ }
+
+ ProfileScope(const ProfileScope&) = delete;
+ ProfileScope& operator=(const ProfileScope&) = delete;
+
+ private:
+ ProfileRegion& _region;
+ uint64_t _start;
+};
+
+// Print one line per region that has been entered: passes, total and mean
+// time, and the median and 99th percentile bins.
+inline void print_profile_report(std::ostream& out) {
+ for (size_t k = 0; k < ProfileRegion::region_count(); k++) {
+  const ProfileRegion& region = *ProfileRegion::regions()[k];
+  if (region.count() == 0) {
+   continue;
+  }
+  out << region.label() << ": " << region.count() << " passes, "
+   << region.total_nanoseconds() / 1e3 << " us total, "
+   << region.total_nanoseconds() / 1e3 / region.count() << " us mean, "
+   << "p50 < " << region.percentile_nanoseconds(0.5) / 1e3 << " us, "
+   << "p99 < " << region.percentile_nanoseconds(0.99) / 1e3 << " us\n";
+ }
+}
+
+// Zero every region's counts.
+inline void reset_profile() {
+ for (size_t k = 0; k < ProfileRegion::region_count(); k++) {
+  ProfileRegion::regions()[k]->reset();
+ }
+}
+
+#ifdef MAXCALORIE_PROFILE
+#define PROFILE_SCOPE(label) \
+ static ProfileRegion MAXCALORIE_STATS_CONCAT(profile_region_, __LINE__)(label); \
+ ProfileScope MAXCALORIE_STATS_CONCAT(profile_scope_, __LINE__)(MAXCALORIE_STATS_CONCAT(profile_region_, __LINE__))
+#else
+#define PROFILE_SCOPE(label) ((void)0)
+#endif